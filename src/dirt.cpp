@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <filesystem>
 #include <iostream>
+#include <list>
 #include <memory>
 #include <optional>
 #include <string>
@@ -9,6 +10,21 @@
 #include <fstream>
 #include <cctype>
 #include <sstream>
+#include <stdexcept>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 #if defined(_WIN32)
 #include <windows.h>
@@ -19,23 +35,51 @@
 #include <termios.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
 #include <limits.h>
+#include <csignal>
+#include <cerrno>
+#if defined(__linux__)
+#include <sys/sysmacros.h>
+#include <sys/inotify.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#define DIRT_HAVE_IO_URING 1
+#endif
+#else
+#include <sys/mount.h>
+#include <sys/param.h>
+#endif
 #if defined(__APPLE__)
 #include <mach-o/dyld.h>
 #endif
 #endif
+// Build with -DDIRT_WITH_ZSTD -lzstd to also search inside .zst files.
+#if defined(DIRT_WITH_ZSTD)
+#include <zstd.h>
+#endif
 
 namespace fs = std::filesystem;
 
 #if defined(_WIN32)
 static const char *HELP_LINE =
-    "[\x18/\x19] move  [\x1b[D] collapse  [\x1b[C] expand  Enter open  [f] find  [r] refresh  [g] top  [G] bottom  [q] quit";
+    "[\x18/\x19] move  [\x1b[D] collapse  [\x1b[C] expand  Enter open  [*] expand all  [f] find  [/] jump  [s] sort  [r] refresh  [g] top  [G] bottom  [q] quit";
 #else
 static const char *HELP_LINE =
-    "[↑/↓] move  [←] collapse  [→] expand  Enter open  [f] find  [r] refresh  [g] top  [G] bottom  [q] quit";
+    "[↑/↓] move  [←] collapse  [→] expand  Enter open  [*] expand all  [f] find  [/] jump  [s] sort  [r] refresh  [g] top  [G] bottom  [q] quit";
 #endif
 
 static constexpr std::uintmax_t SIZE_CAP_BYTES = 2 * 1024 * 1024;
+static constexpr std::uintmax_t DEFAULT_COMPRESSED_LIMIT = 256 * 1024 * 1024;
+static constexpr std::size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
 
 static std::vector<std::string> fallback_editors()
 {
@@ -74,8 +118,310 @@ static void hide_cursor(bool hide) { std::cout << (hide ? "\033[?25l" : "\033[?2
 static void use_alt_screen(bool on) { std::cout << (on ? "\033[?1049h" : "\033[?1049l"); }
 static void clear_screen() { std::cout << "\033[2J"; }
 
+// ---- record / replay ------------------------------------------------------
+// `--record FILE` logs every key and prompt answer with its time offset.
+// `--replay FILE` feeds them back with no terminal attached, drawing into a
+// null stream, and prints draw/toggle/search latency percentiles on exit.
+
+struct InputEvent
+{
+  std::int64_t ms = 0;
+  char kind = 'K'; // 'K' key from read_key, 'L' line from a prompt
+  std::string text;
+};
+
+struct Session
+{
+  bool recording = false;
+  bool replaying = false;
+  std::ofstream log;
+  std::vector<InputEvent> events;
+  std::size_t next = 0;
+  bool exhausted = false; // replay ran out of keys
+  int rows = 24;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+};
+static Session session;
+
+// Printable ASCII stays as is; '\' and everything else become \xHH.
+static std::string escape_field(const std::string &s)
+{
+  static const char *hex = "0123456789abcdef";
+  std::string out;
+  for (unsigned char c : s)
+  {
+    if (c == '\\' || c < 0x21 || c > 0x7e)
+    {
+      out += "\\x";
+      out += hex[c >> 4];
+      out += hex[c & 15];
+    }
+    else
+      out += (char)c;
+  }
+  return out;
+}
+
+// Logs and daemon requests come from outside, so a '\' that isn't followed
+// by two hex digits makes the whole field invalid.
+static std::optional<std::string> unescape_field(const std::string &s)
+{
+  auto digit = [](char c)
+  {
+    return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+  };
+  std::string out;
+  for (std::size_t i = 0; i < s.size(); ++i)
+  {
+    if (s[i] != '\\')
+    {
+      out += s[i];
+      continue;
+    }
+    if (i + 3 >= s.size() || s[i + 1] != 'x' || digit(s[i + 2]) < 0 || digit(s[i + 3]) < 0)
+      return std::nullopt;
+    out += (char)(digit(s[i + 2]) * 16 + digit(s[i + 3]));
+    i += 3;
+  }
+  return out;
+}
+
+static void record_event(char kind, const std::string &text)
+{
+  if (!session.recording)
+    return;
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - session.start).count();
+  session.log << ms << ' ' << kind << ' ' << escape_field(text) << '\n'
+              << std::flush;
+}
+
+static bool load_replay(const std::string &file)
+{
+  std::ifstream f(file);
+  if (!f)
+    return false;
+  std::string line;
+  while (std::getline(f, line))
+  {
+    if (line.rfind("# ", 0) == 0)
+    {
+      auto at = line.find("rows=");
+      if (at != std::string::npos)
+        session.rows = std::max(3, std::atoi(line.c_str() + at + 5));
+      continue;
+    }
+    std::istringstream ls(line);
+    InputEvent e;
+    std::string text;
+    if (!(ls >> e.ms >> e.kind))
+      continue;
+    ls >> text;
+    auto unescaped = unescape_field(text);
+    if (!unescaped)
+      return false;
+    e.text = std::move(*unescaped);
+    session.events.push_back(std::move(e));
+  }
+  session.replaying = true;
+  return true;
+}
+
+// Replay takes the next event of the wanted kind; when the log runs out it
+// answers "q" / "" so every loop unwinds and dirt exits.
+static std::optional<std::string> replay_next(char kind)
+{
+  while (session.next < session.events.size())
+  {
+    InputEvent &e = session.events[session.next++];
+    if (e.kind == kind)
+      return e.text;
+  }
+  return std::nullopt;
+}
+
+class LatencyLog
+{
+public:
+  bool enabled = false;
+
+  void add(const char *what, std::chrono::steady_clock::time_point since)
+  {
+    if (enabled)
+      samples_[what].push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count());
+  }
+
+  void report(std::ostream &os)
+  {
+    os << "event      count      p50 ms      p99 ms      max ms\n";
+    for (auto &[what, v] : samples_)
+    {
+      std::sort(v.begin(), v.end());
+      auto pct = [&](double p)
+      { return v[std::min(v.size() - 1, (std::size_t)(p * (v.size() - 1) + 0.5))]; };
+      char line[128];
+      std::snprintf(line, sizeof(line), "%-8s %7zu %11.3f %11.3f %11.3f\n", what.c_str(), v.size(), pct(0.50), pct(0.99), v.back());
+      os << line;
+    }
+  }
+
+private:
+  std::map<std::string, std::vector<double>> samples_;
+};
+static LatencyLog latency;
+
+struct ScopedLatency
+{
+  const char *what;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  explicit ScopedLatency(const char *w) : what(w) {}
+  ~ScopedLatency() { latency.add(what, start); }
+};
+
+// Swallows everything written to it; stands in for the terminal on replay.
+class NullBuffer : public std::streambuf
+{
+protected:
+  int overflow(int c) override { return c == EOF ? 0 : c; }
+  std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+};
+
+#if !defined(_WIN32)
+
+// ---- daemon connection ----------------------------------------------------
+// `dirt --daemon` keeps directory listings and search results warm for every
+// workspace it is asked about. The TUI talks to it over a Unix socket with a
+// line protocol (fields escaped with escape_field, each reply ends in "END")
+// and quietly works on its own whenever the daemon isn't there.
+
+class LineSocket
+{
+public:
+  explicit LineSocket(int fd) : fd_(fd) {}
+  ~LineSocket() { ::close(fd_); }
+  LineSocket(const LineSocket &) = delete;
+  LineSocket &operator=(const LineSocket &) = delete;
+
+  bool read_line(std::string &line)
+  {
+    for (;;)
+    {
+      auto nl = buf_.find('\n', scanned_);
+      if (nl != std::string::npos)
+      {
+        line.assign(buf_, 0, nl);
+        buf_.erase(0, nl + 1);
+        scanned_ = 0;
+        return true;
+      }
+      scanned_ = buf_.size();
+      char chunk[1 << 14];
+      ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+      if (n <= 0)
+        return false;
+      buf_.append(chunk, (std::size_t)n);
+    }
+  }
+
+  bool write_all(const std::string &data)
+  {
+    for (std::size_t off = 0; off < data.size();)
+    {
+      ssize_t n = ::send(fd_, data.data() + off, data.size() - off, 0);
+      if (n <= 0)
+        return false;
+      off += (std::size_t)n;
+    }
+    return true;
+  }
+
+private:
+  int fd_;
+  std::string buf_;
+  std::size_t scanned_ = 0;
+};
+
+static std::string daemon_socket_path()
+{
+  if (const char *run = std::getenv("XDG_RUNTIME_DIR"))
+    return std::string(run) + "/dirt.sock";
+  return "/tmp/dirt-" + std::to_string(::getuid()) + ".sock";
+}
+
+// The fallback socket lives in world-writable /tmp, where another user could
+// have put one first; only a peer running as us is trusted, either way.
+static bool peer_is_us(int fd)
+{
+#if defined(__linux__)
+  ucred cred{};
+  socklen_t len = sizeof(cred);
+  return ::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == ::getuid();
+#else
+  uid_t uid = 0;
+  gid_t gid = 0;
+  return ::getpeereid(fd, &uid, &gid) == 0 && uid == ::getuid();
+#endif
+}
+
+static int connect_unix(const std::string &path)
+{
+  sockaddr_un addr{};
+  if (path.size() >= sizeof(addr.sun_path))
+    return -1;
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  if (::connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || !peer_is_us(fd))
+  {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static std::unique_ptr<LineSocket> daemon_conn;
+
+static void daemon_attach()
+{
+  int fd = connect_unix(daemon_socket_path());
+  if (fd < 0)
+    return;
+  // A wedged daemon must not hang the UI; a timeout drops us to standalone.
+  timeval tv{5, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  daemon_conn = std::make_unique<LineSocket>(fd);
+}
+
+// Sends one request and collects the reply lines up to "END". Any failure
+// disconnects, and the caller does the work locally from then on.
+static std::optional<std::vector<std::string>> daemon_request(const std::string &request)
+{
+  if (!daemon_conn)
+    return std::nullopt;
+  std::vector<std::string> lines;
+  std::string line;
+  if (daemon_conn->write_all(request + "\n"))
+    while (daemon_conn->read_line(line))
+    {
+      if (line == "END")
+        return lines;
+      if (line == ".") // the daemon is still working
+        continue;
+      if (line.rfind("ERR", 0) == 0)
+        break;
+      lines.push_back(std::move(line));
+    }
+  daemon_conn.reset();
+  return std::nullopt;
+}
+
+#endif
+
 static int terminal_rows()
 {
+  if (session.replaying)
+    return session.rows;
 #if defined(_WIN32)
   CONSOLE_SCREEN_BUFFER_INFO info;
   HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
@@ -90,7 +436,7 @@ static int terminal_rows()
 #endif
 }
 
-static std::string read_key()
+static std::string read_terminal_key()
 {
 #if defined(_WIN32)
   int ch = _getch();
@@ -157,6 +503,85 @@ static std::string read_key()
 #endif
 }
 
+static std::string read_key()
+{
+  // Past the end of the log every prompt gets ESC (which also leaves jump
+  // mode, where 'q' would just be typed) and main stops on `exhausted`.
+  if (session.replaying)
+  {
+    if (auto k = replay_next('K'))
+      return *k;
+    session.exhausted = true;
+    return "\x1b";
+  }
+  std::string k = read_terminal_key();
+  record_event('K', k);
+  return k;
+}
+
+static std::string read_line()
+{
+  if (session.replaying)
+    return replay_next('L').value_or("");
+  std::string s;
+  std::getline(std::cin, s);
+  record_event('L', s);
+  return s;
+}
+
+// Notices keys pressed while a long operation runs, so it can be stopped.
+// Never fires during replay, which always runs operations to the end.
+class KeyPoller
+{
+public:
+  KeyPoller()
+  {
+#if !defined(_WIN32)
+    tty_ = !session.replaying && tcgetattr(STDIN_FILENO, &old_) == 0;
+    if (tty_)
+    {
+      termios raw = old_;
+      raw.c_lflag &= ~(ICANON | ECHO);
+      tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+    }
+#endif
+  }
+
+  ~KeyPoller()
+  {
+#if !defined(_WIN32)
+    if (tty_)
+      tcsetattr(STDIN_FILENO, TCSADRAIN, &old_);
+#endif
+  }
+
+  KeyPoller(const KeyPoller &) = delete;
+  KeyPoller &operator=(const KeyPoller &) = delete;
+
+  // True if a key is waiting; the key is consumed.
+  bool pressed()
+  {
+    if (session.replaying)
+      return false;
+#if defined(_WIN32)
+    if (!_kbhit())
+      return false;
+#else
+    pollfd p{STDIN_FILENO, POLLIN, 0};
+    if (!tty_ || ::poll(&p, 1, 0) <= 0)
+      return false;
+#endif
+    read_terminal_key();
+    return true;
+  }
+
+private:
+#if !defined(_WIN32)
+  termios old_{};
+  bool tty_ = false;
+#endif
+};
+
 static std::string prompt_user(const std::string &label)
 {
   int rows = terminal_rows();
@@ -165,27 +590,286 @@ static std::string prompt_user(const std::string &label)
 
 #if !defined(_WIN32)
   termios oldt{}, cooked{};
-  tcgetattr(STDIN_FILENO, &oldt);
+  bool tty = !session.replaying && tcgetattr(STDIN_FILENO, &oldt) == 0;
   cooked = oldt;
   cooked.c_lflag |= (ICANON | ECHO);
-  tcsetattr(STDIN_FILENO, TCSADRAIN, &cooked);
+  if (tty)
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &cooked);
 #endif
 
   std::cout << "\033[?25h";
   std::cout << label << std::flush;
 
-  std::string s;
-  std::getline(std::cin, s);
+  std::string s = read_line();
 
   std::cout << "\033[?25l";
   std::cout.flush();
 
 #if !defined(_WIN32)
-  tcsetattr(STDIN_FILENO, TCSADRAIN, &oldt);
+  if (tty)
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &oldt);
 #endif
   return s;
 }
 
+static std::string to_lower_copy(std::string s)
+{
+  std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c)
+                 { return std::tolower(c); });
+  return s;
+}
+
+// Accepts plain byte counts or a k/m/g suffix, e.g. "512k" or "64M".
+static std::optional<std::uintmax_t> parse_size(const std::string &s)
+{
+  std::size_t i = 0;
+  std::uintmax_t v = 0;
+  while (i < s.size() && std::isdigit((unsigned char)s[i]))
+    v = v * 10 + (s[i++] - '0');
+  if (i == 0)
+    return std::nullopt;
+  if (i < s.size())
+  {
+    switch (std::tolower((unsigned char)s[i++]))
+    {
+    case 'k':
+      v *= 1024;
+      break;
+    case 'm':
+      v *= 1024 * 1024;
+      break;
+    case 'g':
+      v *= 1024 * 1024 * 1024;
+      break;
+    default:
+      return std::nullopt;
+    }
+    if (i < s.size() && std::tolower((unsigned char)s[i]) == 'b')
+      ++i;
+  }
+  if (i != s.size())
+    return std::nullopt;
+  return v;
+}
+
+static std::string format_bytes(std::uintmax_t n)
+{
+  static const char *units[] = {"B", "KiB", "MiB", "GiB"};
+  double v = (double)n;
+  int u = 0;
+  while (v >= 1024 && u < 3)
+  {
+    v /= 1024;
+    ++u;
+  }
+  std::ostringstream os;
+  os.precision(u == 0 ? 0 : 1);
+  os << std::fixed << v << " " << units[u];
+  return os.str();
+}
+
+// What the tree needs to know about a directory entry, gathered with a single
+// stat when the directory is listed so sorting never goes back to the disk.
+struct EntryMeta
+{
+  fs::path path;
+  bool is_dir = false;
+  std::uintmax_t size = 0;
+  std::int64_t mtime = 0;
+};
+
+static EntryMeta entry_meta(const fs::path &p)
+{
+  EntryMeta m;
+  m.path = p;
+#if defined(_WIN32)
+  std::error_code ec;
+  m.is_dir = fs::is_directory(p, ec);
+  if (!m.is_dir)
+    m.size = fs::file_size(p, ec);
+  m.mtime = fs::last_write_time(p, ec).time_since_epoch().count();
+#else
+  struct stat st;
+  if (::stat(p.c_str(), &st) == 0)
+  {
+    m.is_dir = S_ISDIR(st.st_mode);
+    m.size = m.is_dir ? 0 : (std::uintmax_t)st.st_size;
+    m.mtime = (std::int64_t)st.st_mtime;
+  }
+#endif
+  return m;
+}
+
+// Entry lines are "E <d|f> <size> <mtime> <path>".
+static std::string format_entry(const EntryMeta &m)
+{
+  return "E " + std::string(m.is_dir ? "d " : "f ") + std::to_string(m.size) + " " +
+         std::to_string(m.mtime) + " " + escape_field(m.path.string());
+}
+
+static std::optional<std::vector<EntryMeta>> daemon_list(const fs::path &dir)
+{
+#if defined(_WIN32)
+  (void)dir;
+  return std::nullopt;
+#else
+  auto reply = daemon_request("LIST " + escape_field(dir.string()));
+  if (!reply)
+    return std::nullopt;
+  std::vector<EntryMeta> out;
+  for (auto &line : *reply)
+  {
+    std::istringstream ls(line);
+    std::string tag, kind, path;
+    EntryMeta m;
+    if (ls >> tag >> kind >> m.size >> m.mtime >> path && tag == "E")
+    {
+      auto unescaped = unescape_field(path);
+      if (!unescaped)
+        continue;
+      m.is_dir = (kind == "d");
+      m.path = std::move(*unescaped);
+      out.push_back(std::move(m));
+    }
+  }
+  return out;
+#endif
+}
+
+static std::vector<EntryMeta> list_directory_local(const fs::path &dir)
+{
+  std::vector<EntryMeta> out;
+  std::error_code ec;
+  for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+  {
+#if defined(_WIN32)
+    // The directory scan already filled in size and time.
+    EntryMeta m;
+    m.path = it->path();
+    m.is_dir = it->is_directory(ec);
+    if (!m.is_dir)
+      m.size = it->file_size(ec);
+    m.mtime = it->last_write_time(ec).time_since_epoch().count();
+    ec.clear();
+    out.push_back(std::move(m));
+#else
+    out.push_back(entry_meta(it->path()));
+#endif
+  }
+  return out;
+}
+
+static std::vector<EntryMeta> list_directory(const fs::path &dir)
+{
+  if (auto remote = daemon_list(dir))
+    return std::move(*remote);
+  return list_directory_local(dir);
+}
+
+enum class SortMode
+{
+  Name,
+  Natural,
+  NoCase,
+  Mtime,
+  Size,
+};
+
+static const char *sort_mode_name(SortMode m)
+{
+  switch (m)
+  {
+  case SortMode::Natural:
+    return "natural";
+  case SortMode::NoCase:
+    return "nocase";
+  case SortMode::Mtime:
+    return "mtime";
+  case SortMode::Size:
+    return "size";
+  default:
+    return "name";
+  }
+}
+
+static SortMode sort_mode = SortMode::Name;
+
+static void append_be64(std::string &out, std::uint64_t v)
+{
+  for (int shift = 56; shift >= 0; shift -= 8)
+    out.push_back((char)((v >> shift) & 0xff));
+}
+
+// A byte string that orders entries the way `mode` wants when compared with
+// plain <: folders first, then the mode's ordering, then the raw name.
+static std::string make_sort_key(SortMode mode, bool is_dir, const std::string &name,
+                                 std::uintmax_t size, std::int64_t mtime)
+{
+  std::string key;
+  key.reserve(name.size() * 2 + 12);
+  key.push_back(is_dir ? '0' : '1');
+  switch (mode)
+  {
+  case SortMode::Name:
+    key += name;
+    return key;
+  case SortMode::NoCase:
+    for (unsigned char c : name)
+      key.push_back((char)std::tolower(c));
+    break;
+  case SortMode::Natural:
+    // Digit runs become '0', a two byte length and the digits without leading
+    // zeros, so "file9" < "file10" under byte comparison.
+    for (std::size_t i = 0; i < name.size();)
+    {
+      if (!std::isdigit((unsigned char)name[i]))
+      {
+        key.push_back((char)std::tolower((unsigned char)name[i++]));
+        continue;
+      }
+      std::size_t j = i;
+      while (j < name.size() && std::isdigit((unsigned char)name[j]))
+        ++j;
+      std::size_t k = i;
+      while (k + 1 < j && name[k] == '0')
+        ++k;
+      std::size_t len = std::min<std::size_t>(j - k, 0xffff);
+      key.push_back('0');
+      key.push_back((char)(len >> 8));
+      key.push_back((char)(len & 0xff));
+      key.append(name, k, j - k);
+      i = j;
+    }
+    break;
+  case SortMode::Mtime:
+    append_be64(key, ~((std::uint64_t)mtime ^ (1ull << 63))); // newest first
+    break;
+  case SortMode::Size:
+    append_be64(key, ~(std::uint64_t)size); // largest first
+    break;
+  }
+  key.push_back('\0');
+  key += name;
+  return key;
+}
+
+struct Node;
+
+// Every live Node is counted here. Collapsed directories that still hold their
+// children are kept in an LRU list (front = most recently collapsed) so the
+// stalest ones can drop them once we go over the budget; they are listed again
+// on the next expand.
+struct NodeBudget
+{
+  std::size_t nodes = 0;
+  std::size_t bytes = 0;
+  std::size_t limit = DEFAULT_MEMORY_BUDGET; // 0 = unlimited
+  std::list<Node *> lru;
+};
+static NodeBudget budget;
+
+static void enforce_memory_budget();
+
 struct Node
 {
   fs::path path;
@@ -193,257 +877,3353 @@ struct Node
   Node *parent = nullptr;
   bool isDir = false;
   bool expanded = false;
+  std::uintmax_t size = 0;
+  std::int64_t mtime = 0;
+  std::string sort_key;
   std::vector<std::unique_ptr<Node>> children;
+  std::size_t footprint = 0;
+  bool in_lru = false;
+  std::list<Node *>::iterator lru_pos;
 
-  explicit Node(fs::path p, Node *par = nullptr) : path(std::move(p)), parent(par)
+  explicit Node(EntryMeta meta, Node *par = nullptr)
+      : path(std::move(meta.path)), parent(par), isDir(meta.is_dir), size(meta.size), mtime(meta.mtime)
   {
-    isDir = fs::is_directory(path);
     name = path.filename().empty() ? path.string() : path.filename().string();
+    sort_key = make_sort_key(sort_mode, isDir, name, size, mtime);
+    ++budget.nodes;
+    recount();
+  }
+
+  ~Node()
+  {
+    children.clear();
+    unlink_lru();
+    --budget.nodes;
+    budget.bytes -= footprint;
+  }
+
+  Node(const Node &) = delete;
+  Node &operator=(const Node &) = delete;
+
+  // Rough heap cost of this node alone; children account for themselves.
+  void recount()
+  {
+    std::size_t now = sizeof(Node) +
+                      path.native().capacity() * sizeof(fs::path::value_type) +
+                      name.capacity() + sort_key.capacity() +
+                      children.capacity() * sizeof(std::unique_ptr<Node>);
+    budget.bytes = budget.bytes - footprint + now;
+    footprint = now;
   }
 
-  void toggle()
-  {
-    if (!isDir)
-      return;
-    expanded = !expanded;
-    if (expanded && children.empty())
+  void touch_lru()
+  {
+    unlink_lru();
+    budget.lru.push_front(this);
+    lru_pos = budget.lru.begin();
+    in_lru = true;
+  }
+
+  void unlink_lru()
+  {
+    if (!in_lru)
+      return;
+    budget.lru.erase(lru_pos);
+    in_lru = false;
+  }
+
+  void rekey()
+  {
+    sort_key = make_sort_key(sort_mode, isDir, name, size, mtime);
+    recount();
+  }
+
+  void load_children();
+
+  void release_children()
+  {
+    unlink_lru();
+    std::vector<std::unique_ptr<Node>>().swap(children);
+    recount();
+  }
+
+  void toggle()
+  {
+    if (!isDir)
+      return;
+    expanded = !expanded;
+    if (!expanded)
+    {
+      if (!children.empty())
+        touch_lru();
+      enforce_memory_budget();
+      return;
+    }
+    unlink_lru();
+    if (children.empty())
+    {
+      try
+      {
+        load_children();
+      }
+      catch (...)
+      {
+      }
+      recount();
+    }
+    enforce_memory_budget();
+  }
+};
+
+// Only collapsed nodes are ever in the LRU, so nothing visible is released.
+static void enforce_memory_budget()
+{
+  while (budget.limit && budget.bytes > budget.limit && !budget.lru.empty())
+    budget.lru.back()->release_children();
+}
+
+static constexpr std::size_t PARALLEL_SORT_MIN = 16384;
+
+static void sort_children(std::vector<std::unique_ptr<Node>> &v)
+{
+  auto less = [](const std::unique_ptr<Node> &a, const std::unique_ptr<Node> &b)
+  { return a->sort_key < b->sort_key; };
+  unsigned threads = std::min(std::thread::hardware_concurrency(), 8u);
+  if (v.size() < PARALLEL_SORT_MIN || threads < 2)
+  {
+    std::sort(v.begin(), v.end(), less);
+    return;
+  }
+
+  // Sort equal chunks on their own threads, then merge neighbours pairwise.
+  std::vector<std::size_t> bounds;
+  for (unsigned t = 0; t <= threads; ++t)
+    bounds.push_back(v.size() * t / threads);
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; ++t)
+    pool.emplace_back([&, t]
+                      { std::sort(v.begin() + bounds[t], v.begin() + bounds[t + 1], less); });
+  for (auto &th : pool)
+    th.join();
+  for (std::size_t width = 1; width < threads; width *= 2)
+  {
+    pool.clear();
+    for (std::size_t t = 0; t + width < threads; t += 2 * width)
+    {
+      std::size_t lo = bounds[t], mid = bounds[t + width], hi = bounds[std::min<std::size_t>(t + 2 * width, threads)];
+      pool.emplace_back([&v, lo, mid, hi, less]
+                        { std::inplace_merge(v.begin() + lo, v.begin() + mid, v.begin() + hi, less); });
+    }
+    for (auto &th : pool)
+      th.join();
+  }
+}
+
+void Node::load_children()
+{
+  auto entries = list_directory(path);
+  children.reserve(entries.size());
+  for (auto &e : entries)
+    children.emplace_back(std::make_unique<Node>(std::move(e), this));
+  sort_children(children);
+}
+
+// Re-keys and re-sorts everything already loaded; nothing is read from disk.
+static void resort_tree(Node *n)
+{
+  if (n->children.empty())
+    return;
+  for (auto &c : n->children)
+  {
+    c->rekey();
+    resort_tree(c.get());
+  }
+  sort_children(n->children);
+}
+
+static void collect_visible(Node *root, int depth, std::vector<std::pair<Node *, int>> &out)
+{
+  out.emplace_back(root, depth);
+  if (root->isDir && root->expanded)
+    for (auto &c : root->children)
+      collect_visible(c.get(), depth + 1, out);
+}
+static std::vector<std::pair<Node *, int>> visible_nodes(Node *root)
+{
+  std::vector<std::pair<Node *, int>> v;
+  collect_visible(root, 0, v);
+  return v;
+}
+
+static bool starts_with_nocase(const std::string &s, const std::string &lower_prefix)
+{
+  if (s.size() < lower_prefix.size())
+    return false;
+  for (std::size_t i = 0; i < lower_prefix.size(); ++i)
+    if (std::tolower((unsigned char)s[i]) != lower_prefix[i])
+      return false;
+  return true;
+}
+
+// First child, in display order, whose name starts with `prefix`. Name and
+// nocase keys begin with the (folded) name, so the matches are one contiguous
+// run per folder/file group and a binary search finds them; the other modes
+// fall back to a scan. Matching is case-sensitive only in name mode.
+static Node *first_with_prefix(const std::vector<std::unique_ptr<Node>> &kids, const std::string &prefix)
+{
+  if (sort_mode == SortMode::Name || sort_mode == SortMode::NoCase)
+  {
+    std::string folded = sort_mode == SortMode::NoCase ? to_lower_copy(prefix) : prefix;
+    for (char group : {'0', '1'})
+    {
+      std::string target = group + folded;
+      auto it = std::lower_bound(kids.begin(), kids.end(), target,
+                                 [](const std::unique_ptr<Node> &n, const std::string &t)
+                                 { return n->sort_key < t; });
+      if (it != kids.end() && (*it)->sort_key.compare(0, target.size(), target) == 0)
+        return it->get();
+    }
+    return nullptr;
+  }
+  std::string lower = to_lower_copy(prefix);
+  for (auto &c : kids)
+    if (starts_with_nocase(c->name, lower))
+      return c.get();
+  return nullptr;
+}
+
+// Looks among the selection's siblings first, then one level up at a time.
+static Node *jump_target(Node *from, const std::string &prefix)
+{
+  for (Node *dir = from->parent; dir; dir = dir->parent)
+    if (Node *hit = first_with_prefix(dir->children, prefix))
+      return hit;
+  if (!from->parent && from->expanded)
+    return first_with_prefix(from->children, prefix);
+  return nullptr;
+}
+
+static std::optional<std::string> exe_dir_path()
+{
+#if defined(_WIN32)
+  char buf[MAX_PATH];
+  DWORD len = GetModuleFileNameA(nullptr, buf, MAX_PATH);
+  if (len == 0 || len == MAX_PATH)
+    return std::nullopt;
+  return fs::path(buf).parent_path().string();
+#else
+  // Linux: /proc/self/exe, macOS: _NSGetExecutablePath
+  fs::path p;
+#if defined(__APPLE__)
+  uint32_t size = 0;
+  _NSGetExecutablePath(nullptr, &size);
+  std::string tmp(size, '\0');
+  if (_NSGetExecutablePath(tmp.data(), &size) != 0)
+    return std::nullopt;
+  p = fs::path(tmp).lexically_normal();
+#else
+  char buf[PATH_MAX];
+  ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+  if (n < 0)
+    return std::nullopt;
+  buf[n] = '\0';
+  p = fs::path(buf);
+#endif
+  return p.parent_path().string();
+#endif
+}
+
+// The config is parsed once and parsed again only when the file changes, so
+// lookups on hot paths (every search, every open) cost a stat at most.
+struct ConfigCache
+{
+  std::mutex m;
+  bool located = false;
+  std::optional<fs::path> file;
+  fs::file_time_type mtime{};
+  std::vector<std::pair<std::string, std::string>> entries; // in file order
+  std::uint64_t generation = 0;                              // bumped on every reload
+};
+static ConfigCache config_cache;
+
+// Call with config_cache.m held.
+static void refresh_config()
+{
+  if (!config_cache.located)
+  {
+    config_cache.located = true;
+    if (auto dir = exe_dir_path())
+      config_cache.file = fs::path(*dir) / ".dirtconfig";
+  }
+  std::error_code ec;
+  fs::file_time_type mtime{};
+  if (config_cache.file)
+    mtime = fs::last_write_time(*config_cache.file, ec);
+  if (!config_cache.file || ec)
+  {
+    if (!config_cache.entries.empty() || config_cache.mtime != fs::file_time_type{})
+    {
+      config_cache.entries.clear();
+      config_cache.mtime = {};
+      ++config_cache.generation;
+    }
+    return;
+  }
+  if (mtime == config_cache.mtime && config_cache.generation > 0)
+    return;
+
+  config_cache.entries.clear();
+  config_cache.mtime = mtime;
+  ++config_cache.generation;
+  std::ifstream f(*config_cache.file);
+  std::string line;
+  while (std::getline(f, line))
+  {
+    line.erase(0, line.find_first_not_of(" \t\r\n"));
+    if (!line.empty())
+      line.erase(line.find_last_not_of(" \t\r\n") + 1);
+    auto eq = line.find('=');
+    if (line.empty() || line[0] == '#' || eq == std::string::npos)
+      continue;
+    config_cache.entries.emplace_back(line.substr(0, eq), line.substr(eq + 1));
+  }
+}
+
+static std::uint64_t config_generation()
+{
+  std::lock_guard<std::mutex> lock(config_cache.m);
+  try
+  {
+    refresh_config();
+  }
+  catch (...)
+  {
+  }
+  return config_cache.generation;
+}
+
+static std::optional<std::string> read_config_value(const std::string &key)
+{
+  std::lock_guard<std::mutex> lock(config_cache.m);
+  try
+  {
+    refresh_config();
+    for (auto it = config_cache.entries.rbegin(); it != config_cache.entries.rend(); ++it)
+      if (it->first == key)
+        return it->second;
+  }
+  catch (...)
+  {
+  }
+  return std::nullopt;
+}
+
+static bool config_flag(const std::string &key, bool fallback)
+{
+  auto v = read_config_value(key);
+  if (!v)
+    return fallback;
+  std::string l = *v;
+  std::transform(l.begin(), l.end(), l.begin(), ::tolower);
+  if (l == "1" || l == "true" || l == "yes" || l == "on")
+    return true;
+  if (l == "0" || l == "false" || l == "no" || l == "off")
+    return false;
+  return fallback;
+}
+
+// Comma separated, surrounding blanks ignored: "skip_dirs=.git, node_modules".
+static std::vector<std::string> config_list(const std::string &key, const std::string &fallback)
+{
+  std::vector<std::string> out;
+  std::istringstream in(read_config_value(key).value_or(fallback));
+  std::string item;
+  while (std::getline(in, item, ','))
+  {
+    item.erase(0, item.find_first_not_of(" \t"));
+    if (!item.empty())
+      item.erase(item.find_last_not_of(" \t") + 1);
+    if (!item.empty())
+      out.push_back(item);
+  }
+  return out;
+}
+
+// An ".ext=" line wins over editor_generic; the first ".ext=" line counts,
+// the last editor_generic does.
+static std::optional<std::string> read_editor_for_ext(const std::string &ext)
+{
+  std::string ext_lower = to_lower_copy(ext);
+  std::lock_guard<std::mutex> lock(config_cache.m);
+  try
+  {
+    refresh_config();
+    std::string generic;
+    for (auto &[key, value] : config_cache.entries)
+    {
+      if (key == "editor_generic")
+        generic = value;
+      else if (!ext_lower.empty() && key == ext_lower)
+        return value;
+    }
+    if (!generic.empty())
+      return generic;
+  }
+  catch (...)
+  {
+  }
+  return std::nullopt;
+}
+
+struct ScopedAltScreenPause
+{
+  ScopedAltScreenPause()
+  {
+    std::cout << "\033[?1049l\033[?25h";
+    std::cout.flush();
+  }
+  ~ScopedAltScreenPause()
+  {
+    std::cout << "\033[?1049h\033[?25l\033[2J\033[H";
+    std::cout.flush();
+  }
+};
+
+// ---- editor launch --------------------------------------------------------
+// Editors are started directly (posix_spawn, _spawnv on Windows) with a real
+// argv, so no shell runs and paths need no quoting. Which editor a file type
+// gets and where it lives on PATH are worked out once per session; the
+// editor choice is redone only after the config file changes.
+
+#if defined(_WIN32)
+static constexpr char PATH_LIST_SEP = ';';
+#else
+extern char **environ;
+static constexpr char PATH_LIST_SEP = ':';
+#endif
+
+// Full path of `name`, searched on PATH unless it already has a directory.
+static std::optional<std::string> find_executable(const std::string &name)
+{
+  static std::unordered_map<std::string, std::optional<std::string>> cache;
+  auto hit = cache.find(name);
+  if (hit != cache.end())
+    return hit->second;
+
+  auto runnable = [](const fs::path &p)
+  {
+    std::error_code ec;
+    if (!fs::is_regular_file(p, ec))
+      return false;
+#if defined(_WIN32)
+    return true;
+#else
+    return ::access(p.c_str(), X_OK) == 0;
+#endif
+  };
+#if defined(_WIN32)
+  static const char *const exts[] = {"", ".exe", ".com", ".bat", ".cmd"};
+#else
+  static const char *const exts[] = {""};
+#endif
+
+  std::vector<fs::path> dirs;
+  if (fs::path(name).has_parent_path())
+    dirs.emplace_back();
+  else if (const char *path = std::getenv("PATH"))
+  {
+    std::istringstream in(path);
+    std::string dir;
+    while (std::getline(in, dir, PATH_LIST_SEP))
+      dirs.emplace_back(dir.empty() ? "." : dir);
+  }
+
+  std::optional<std::string> found;
+  for (std::size_t i = 0; i < dirs.size() && !found; ++i)
+    for (const char *ext : exts)
+    {
+      fs::path candidate = dirs[i].empty() ? fs::path(name + ext) : dirs[i] / (name + ext);
+      if (runnable(candidate))
+      {
+        found = candidate.string();
+        break;
+      }
+    }
+  cache.emplace(name, found);
+  return found;
+}
+
+// "code --wait" -> {"code", "--wait"}; single or double quotes group words.
+// A value naming an existing file is taken whole, so unquoted paths with
+// spaces (C:\Program Files\...) keep working.
+static std::vector<std::string> split_command(const std::string &cmd)
+{
+  std::error_code ec;
+  if (fs::is_regular_file(cmd, ec))
+    return {cmd};
+  std::vector<std::string> words;
+  std::string cur;
+  bool in_word = false;
+  char quote = 0;
+  for (char c : cmd)
+  {
+    if (quote)
+    {
+      if (c == quote)
+        quote = 0;
+      else
+        cur += c;
+    }
+    else if (c == '"' || c == '\'')
+    {
+      quote = c;
+      in_word = true;
+    }
+    else if (c == ' ' || c == '\t')
+    {
+      if (in_word)
+        words.push_back(std::move(cur));
+      cur.clear();
+      in_word = false;
+    }
+    else
+    {
+      cur += c;
+      in_word = true;
+    }
+  }
+  if (in_word)
+    words.push_back(std::move(cur));
+  return words;
+}
+
+struct EditorCommand
+{
+  std::string program;           // resolved path
+  std::vector<std::string> args; // extra words from the config, before the file
+  std::string kind;              // lower-case program name, picks the line syntax
+};
+
+static std::optional<EditorCommand> resolve_command(const std::string &cmd)
+{
+  auto words = split_command(cmd);
+  if (words.empty())
+    return std::nullopt;
+  auto program = find_executable(words[0]);
+  if (!program)
+    return std::nullopt;
+  return EditorCommand{*program, {words.begin() + 1, words.end()}, to_lower_copy(fs::path(words[0]).stem().string())};
+}
+
+// The configured editor for `ext`, else the first fallback that is installed.
+static std::optional<EditorCommand> pick_editor(const std::string &ext = "")
+{
+  static std::unordered_map<std::string, std::optional<EditorCommand>> cache;
+  static std::uint64_t cached_generation = ~std::uint64_t(0);
+  std::uint64_t generation = config_generation();
+  if (generation != cached_generation)
+  {
+    cache.clear();
+    cached_generation = generation;
+  }
+  std::string key = to_lower_copy(ext);
+  auto hit = cache.find(key);
+  if (hit != cache.end())
+    return hit->second;
+
+  std::optional<EditorCommand> found;
+  if (auto cfg = read_editor_for_ext(ext))
+    found = resolve_command(*cfg);
+  for (auto &e : fallback_editors())
+  {
+    if (found)
+      break;
+    if (!e.empty())
+      found = resolve_command(e);
+  }
+  cache.emplace(key, found);
+  return found;
+}
+
+// How each editor is told to start at a line; unknown ones just get the file.
+static std::vector<std::string> file_args(const std::string &kind, const std::string &file, int line)
+{
+  if (line <= 0)
+    return {file};
+  std::string n = std::to_string(line);
+  static const char *const plus_line[] = {"vi", "vim", "nvim", "gvim", "mvim", "view", "emacs", "emacsclient",
+                                          "nano", "micro", "kak", "gedit", "joe", "jed", "mg", "less"};
+  for (const char *k : plus_line)
+    if (kind == k)
+      return {"+" + n, file};
+  if (kind.find("vim") != std::string::npos)
+    return {"+" + n, file};
+  if (kind == "code" || kind == "code-insiders" || kind == "codium")
+    return {"-g", file + ":" + n};
+  if (kind == "subl" || kind == "sublime_text" || kind == "hx" || kind == "helix" || kind == "zed")
+    return {file + ":" + n};
+  if (kind == "notepad++")
+    return {"-n" + n, file};
+  return {file};
+}
+
+// Starts `argv` and waits for it to exit.
+static void run_and_wait(const std::string &program, const std::vector<std::string> &argv)
+{
+#if defined(_WIN32)
+  // _spawnv joins the arguments with spaces, so ones containing spaces are quoted.
+  std::vector<std::string> quoted;
+  for (auto &a : argv)
+    quoted.push_back(a.find_first_of(" \t") == std::string::npos ? a : "\"" + a + "\"");
+  std::vector<const char *> args;
+  for (auto &a : quoted)
+    args.push_back(a.c_str());
+  args.push_back(nullptr);
+  _spawnv(_P_WAIT, program.c_str(), args.data());
+#else
+  std::vector<char *> args;
+  for (auto &a : argv)
+    args.push_back(const_cast<char *>(a.c_str()));
+  args.push_back(nullptr);
+
+  // As system() does: Ctrl-C and Ctrl-\ go to the editor while it runs, and it
+  // starts with default handlers even for signals we ignore (SIGPIPE).
+  struct sigaction ignore{}, old_int{}, old_quit{};
+  ignore.sa_handler = SIG_IGN;
+  sigemptyset(&ignore.sa_mask);
+  sigaction(SIGINT, &ignore, &old_int);
+  sigaction(SIGQUIT, &ignore, &old_quit);
+
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t defaults;
+  sigemptyset(&defaults);
+  sigaddset(&defaults, SIGINT);
+  sigaddset(&defaults, SIGQUIT);
+  sigaddset(&defaults, SIGPIPE);
+  posix_spawnattr_setsigdefault(&attr, &defaults);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+  pid_t pid;
+  if (posix_spawn(&pid, program.c_str(), nullptr, &attr, args.data(), environ) == 0)
+    while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR)
+      ;
+  posix_spawnattr_destroy(&attr);
+
+  sigaction(SIGINT, &old_int, nullptr);
+  sigaction(SIGQUIT, &old_quit, nullptr);
+#endif
+}
+
+static void open_in_editor_at(const fs::path &p, int line)
+{
+  if (session.replaying)
+    return;
+  std::string ext = p.has_extension() ? p.extension().string() : "";
+  std::string file = p.string();
+  auto ed = pick_editor(ext);
+  if (!ed)
+  {
+#if defined(_WIN32)
+    ShellExecuteA(NULL, "open", file.c_str(), NULL, NULL, SW_SHOWNORMAL);
+#else
+    if (auto opener = find_executable("xdg-open"))
+      run_and_wait(*opener, {*opener, file});
+#endif
+    return;
+  }
+
+  std::vector<std::string> argv{ed->program};
+  argv.insert(argv.end(), ed->args.begin(), ed->args.end());
+  for (auto &a : file_args(ed->kind, file, line))
+    argv.push_back(std::move(a));
+  run_and_wait(ed->program, argv);
+}
+
+static void open_in_editor(const fs::path &p) { open_in_editor_at(p, -1); }
+
+struct Match
+{
+  fs::path file;
+  int line;
+  std::string preview;
+};
+
+// A file the search will read, with whatever metadata the enumerator already
+// had on hand so the workers never need to stat it again.
+struct Candidate
+{
+  fs::path path;
+  std::uintmax_t size = 0;
+  std::int64_t mtime = 0;
+};
+
+// ---- traversal ------------------------------------------------------------
+// Directories are identified by (device, inode) so symlink loops, bind mounts
+// and hard-linked files are only read once, and mount points can be refused
+// either outright (one_filesystem) or by filesystem type.
+
+struct WalkOptions
+{
+  bool one_filesystem = false;
+  bool follow_symlinks = false;
+  std::vector<std::string> skip_dirs;
+  std::vector<std::string> skip_fs_types;
+
+  bool skips_dir(const std::string &name) const
+  {
+    return std::find(skip_dirs.begin(), skip_dirs.end(), name) != skip_dirs.end();
+  }
+};
+
+static WalkOptions walk_options()
+{
+  WalkOptions o;
+  o.one_filesystem = config_flag("one_filesystem", false);
+  o.follow_symlinks = config_flag("follow_symlinks", false);
+  o.skip_dirs = config_list("skip_dirs", "");
+  o.skip_fs_types = config_list("skip_fs_types",
+                                "proc,sysfs,devtmpfs,devpts,cgroup,cgroup2,debugfs,tracefs,securityfs,"
+                                "pstore,bpf,configfs,fusectl,mqueue,hugetlbfs,autofs,binfmt_misc");
+  return o;
+}
+
+#if !defined(_WIN32)
+static bool stat_path(const fs::path &p, struct stat &st) { return ::stat(p.c_str(), &st) == 0; }
+#endif
+
+class DirGuard
+{
+public:
+  explicit DirGuard(const WalkOptions &opts) : opts_(opts) {}
+
+  // Called for the walk root and every directory before descending into it.
+  // `parent_dev` is the device of the directory holding it (0 for the root).
+  bool enter(const fs::path &dir, std::uint64_t parent_dev, std::uint64_t &dev)
+  {
+#if defined(_WIN32)
+    (void)dir;
+    dev = parent_dev;
+    return true;
+#else
+    struct stat st;
+    if (!stat_path(dir, st))
+      return false;
+    dev = (std::uint64_t)st.st_dev;
+    if (parent_dev == 0)
+      root_dev_ = dev;
+    else if (dev != parent_dev)
+    {
+      if (opts_.one_filesystem && dev != root_dev_)
+        return false;
+      if (skipped_type(dev, dir))
+        return false;
+    }
+    return seen_.insert({dev, (std::uint64_t)st.st_ino}).second;
+#endif
+  }
+
+  // Regular files reachable more than once (symlinks, hard links) are only
+  // searched the first time.
+  bool first_visit(std::uint64_t dev, std::uint64_t ino) { return seen_.insert({dev, ino}).second; }
+
+private:
+  struct KeyHash
+  {
+    std::size_t operator()(const std::pair<std::uint64_t, std::uint64_t> &k) const
+    {
+      return std::hash<std::uint64_t>()(k.first * 0x9e3779b97f4a7c15ull ^ k.second);
+    }
+  };
+
+  bool skipped_type(std::uint64_t dev, const fs::path &dir)
+  {
+    if (opts_.skip_fs_types.empty())
+      return false;
+    auto it = types_.find(dev);
+    if (it == types_.end())
+      it = types_.emplace(dev, fs_type(dev, dir)).first;
+    const std::string &type = it->second;
+    for (auto &t : opts_.skip_fs_types)
+      if (type == t || (type.rfind("fuse.", 0) == 0 && type.compare(5, std::string::npos, t) == 0))
+        return true;
+    return false;
+  }
+
+  static std::string fs_type(std::uint64_t dev, const fs::path &dir)
+  {
+#if defined(__linux__)
+    // mountinfo: "36 35 98:0 /root /mnt rw,noatime master:1 - ext3 /dev/root rw"
+    (void)dir;
+    std::ifstream f("/proc/self/mountinfo");
+    std::string line;
+    while (std::getline(f, line))
+    {
+      std::istringstream ls(line);
+      std::string id, parent, majmin;
+      ls >> id >> parent >> majmin;
+      auto colon = majmin.find(':');
+      if (colon == std::string::npos)
+        continue;
+      unsigned maj = std::strtoul(majmin.c_str(), nullptr, 10);
+      unsigned min = std::strtoul(majmin.c_str() + colon + 1, nullptr, 10);
+      if (makedev(maj, min) != dev)
+        continue;
+      auto sep = line.find(" - ");
+      if (sep == std::string::npos)
+        continue;
+      std::istringstream rest(line.substr(sep + 3));
+      std::string type;
+      rest >> type;
+      return type;
+    }
+    return "";
+#elif defined(_WIN32)
+    (void)dev;
+    (void)dir;
+    return "";
+#else
+    (void)dev;
+    struct statfs sf;
+    if (::statfs(dir.c_str(), &sf) != 0)
+      return "";
+    return sf.f_fstypename;
+#endif
+  }
+
+  const WalkOptions &opts_;
+  std::uint64_t root_dev_ = 0;
+  std::unordered_set<std::pair<std::uint64_t, std::uint64_t>, KeyHash> seen_;
+  std::unordered_map<std::uint64_t, std::string> types_;
+};
+
+// ---- query filters --------------------------------------------------------
+// A search query may carry filters next to the text, e.g.
+//   "ext:cpp,h path:src/ -path:test size:<100k TODO"
+// They are checked against names and stat data while the file list is built,
+// so files they reject are never opened, and folders that can't contain a
+// match are not walked at all. Paths are relative to the search root with
+// '/' separators; a path term starting with '/' is anchored at the root.
+
+enum class Compression
+{
+  None,
+  Gzip,
+  Zstd
+};
+
+static Compression compression_of(const std::string &name)
+{
+  auto ends_with = [&](const char *ext)
+  {
+    std::size_t n = std::strlen(ext);
+    return name.size() > n && to_lower_copy(name.substr(name.size() - n)) == ext;
+  };
+  if (ends_with(".gz"))
+    return Compression::Gzip;
+#if defined(DIRT_WITH_ZSTD)
+  if (ends_with(".zst"))
+    return Compression::Zstd;
+#endif
+  return Compression::None;
+}
+
+struct QueryFilter
+{
+  std::string text; // what to look for inside files, lower case; may be empty
+  std::vector<std::string> exts, not_exts;
+  std::vector<std::string> paths, not_paths;
+  std::uintmax_t min_size = 0;
+  std::uintmax_t max_size = UINTMAX_MAX;
+  std::string canonical; // the filter part only, for cache keys
+
+  // Set when the files are going to be read: plain files over `read_cap`
+  // are skipped, compressed ones are streamed whatever their size.
+  std::uintmax_t read_cap = UINTMAX_MAX;
+  bool stream_compressed = false;
+
+  bool has_path_terms() const { return !paths.empty() || !not_paths.empty(); }
+
+  // `rel` is "/dir/sub/" for a folder below the search root.
+  bool may_contain(const std::string &rel) const
+  {
+    for (auto &p : not_paths)
+      if (rel.find(p) != std::string::npos)
+        return false;
+    for (auto &p : paths)
+      if (p[0] == '/' && rel.compare(0, p.size(), p) != 0 && p.compare(0, rel.size(), rel) != 0)
+        return false;
+    return true;
+  }
+
+  // Extensions match as name suffixes, so "tar.gz" and "min.js" work too.
+  // A leading dot doesn't start an extension (".bashrc" has none).
+  bool wants_name(const std::string &name) const
+  {
+    if (exts.empty() && not_exts.empty())
+      return true;
+    std::string lower = to_lower_copy(name);
+    auto has = [&](const std::string &ext)
+    {
+      return lower.size() > ext.size() + 1 && lower[lower.size() - ext.size() - 1] == '.' &&
+             lower.compare(lower.size() - ext.size(), ext.size(), ext) == 0;
+    };
+    if (!exts.empty() && std::none_of(exts.begin(), exts.end(), has))
+      return false;
+    return std::none_of(not_exts.begin(), not_exts.end(), has);
+  }
+
+  // `rel` is "/dir/file" relative to the search root.
+  bool wants_path(const std::string &rel) const
+  {
+    for (auto &p : not_paths)
+      if (rel.find(p) != std::string::npos)
+        return false;
+    for (auto &p : paths)
+      if (p[0] == '/' ? rel.compare(0, p.size(), p) != 0 : rel.find(p) == std::string::npos)
+        return false;
+    return true;
+  }
+
+  bool wants_size(std::uintmax_t size, const std::string &name) const
+  {
+    if (size < min_size || size > max_size)
+      return false;
+    return size <= read_cap || (stream_compressed && compression_of(name) != Compression::None);
+  }
+};
+
+static QueryFilter parse_query(const std::string &raw)
+{
+  QueryFilter f;
+  std::istringstream in(raw);
+  std::string tok, text;
+  std::vector<std::string> kept;
+  bool filtered = false;
+  while (in >> tok)
+  {
+    bool neg = tok.size() > 1 && tok[0] == '-';
+    std::string t = neg ? tok.substr(1) : tok;
+    auto colon = t.find(':');
+    std::string key = colon == std::string::npos ? "" : t.substr(0, colon);
+    std::string val = colon == std::string::npos ? "" : t.substr(colon + 1);
+    if (val.empty() || (key != "ext" && key != "path" && key != "size"))
+    {
+      kept.push_back(tok);
+      continue;
+    }
+    if (key == "ext")
+    {
+      std::istringstream parts(val);
+      std::string e;
+      while (std::getline(parts, e, ','))
+      {
+        if (!e.empty() && e[0] == '.')
+          e.erase(0, 1);
+        if (!e.empty())
+          (neg ? f.not_exts : f.exts).push_back(to_lower_copy(e));
+      }
+    }
+    else if (key == "path")
+    {
+      std::replace(val.begin(), val.end(), '\\', '/');
+      (neg ? f.not_paths : f.paths).push_back(val);
+    }
+    else
+    {
+      std::string op;
+      while (!val.empty() && (val[0] == '<' || val[0] == '>' || val[0] == '='))
+      {
+        op += val[0];
+        val.erase(0, 1);
+      }
+      auto n = parse_size(val);
+      if (!n)
+      {
+        kept.push_back(tok);
+        continue;
+      }
+      if (neg)
+        op = op == "<" ? ">=" : op == "<=" ? ">" : op == ">" ? "<=" : op == ">=" ? "<" : op;
+      if (op == "<")
+        f.max_size = std::min(f.max_size, *n ? *n - 1 : 0);
+      else if (op == "<=")
+        f.max_size = std::min(f.max_size, *n);
+      else if (op == ">")
+        f.min_size = std::max(f.min_size, *n + 1);
+      else if (op == ">=")
+        f.min_size = std::max(f.min_size, *n);
+      else
+      {
+        f.min_size = std::max(f.min_size, *n);
+        f.max_size = std::min(f.max_size, *n);
+      }
+    }
+    filtered = true;
+    f.canonical += (f.canonical.empty() ? "" : " ") + tok;
+  }
+  if (!filtered)
+    f.text = to_lower_copy(raw);
+  else
+    for (auto &k : kept)
+      f.text += (f.text.empty() ? "" : " ") + to_lower_copy(k);
+  return f;
+}
+
+// For queries that read files: skip plain files over the size cap, unless
+// they are compressed and search_compressed is on.
+static void limit_reads(QueryFilter &filter)
+{
+  filter.read_cap = SIZE_CAP_BYTES;
+  filter.stream_compressed = config_flag("search_compressed", false);
+}
+
+static std::vector<Candidate> walk_candidates(const fs::path &base, const QueryFilter &filter)
+{
+  WalkOptions opts = walk_options();
+  DirGuard guard(opts);
+  std::vector<Candidate> out;
+  const bool by_path = filter.has_path_terms();
+
+  struct Pending
+  {
+    fs::path dir;
+    std::string rel; // "/a/b/"
+    std::uint64_t dev;
+  };
+  std::vector<Pending> stack;
+  std::uint64_t root_dev = 0;
+  if (guard.enter(base, 0, root_dev))
+    stack.push_back({base, "/", root_dev});
+
+  std::vector<std::pair<fs::path, std::string>> subdirs;
+  std::error_code ec;
+  while (!stack.empty())
+  {
+    Pending cur = std::move(stack.back());
+    stack.pop_back();
+    subdirs.clear();
+    for (fs::directory_iterator it(cur.dir, fs::directory_options::skip_permission_denied, ec), end; it != end; it.increment(ec))
+    {
+      const fs::path &p = it->path();
+      std::string name = p.filename().string();
+      bool link = it->is_symlink(ec);
+      if (it->is_directory(ec))
+      {
+        if ((!link || opts.follow_symlinks) && !opts.skips_dir(name))
+        {
+          std::string rel = cur.rel + name + "/";
+          if (filter.may_contain(rel))
+            subdirs.emplace_back(p, std::move(rel));
+        }
+        continue;
+      }
+      if (!filter.wants_name(name) || (by_path && !filter.wants_path(cur.rel + name)))
+        continue;
+#if defined(_WIN32)
+      std::uintmax_t size = it->file_size(ec);
+      if (ec || !filter.wants_size(size, name))
+        continue;
+      out.push_back({p, size, 0});
+#else
+      struct stat st;
+      if (!stat_path(p, st) || !S_ISREG(st.st_mode) || !filter.wants_size((std::uintmax_t)st.st_size, name))
+        continue;
+      if ((link || st.st_nlink > 1) && !guard.first_visit(st.st_dev, st.st_ino))
+        continue;
+      out.push_back({p, (std::uintmax_t)st.st_size, (std::int64_t)st.st_mtime});
+#endif
+    }
+    // Reverse so the stack pops them in listing order.
+    for (auto it = subdirs.rbegin(); it != subdirs.rend(); ++it)
+    {
+      std::uint64_t dev = 0;
+      if (guard.enter(it->first, cur.dev, dev))
+        stack.push_back({it->first, std::move(it->second), dev});
+    }
+  }
+  return out;
+}
+
+// ---- git index ------------------------------------------------------------
+// Reads the tracked file list straight out of .git/index (versions 2-4) so a
+// search inside a repository never walks untracked build or vendor trees.
+
+struct GitIndexEntry
+{
+  std::string path; // relative to the work tree, '/' separated
+  std::uint32_t size = 0;
+  std::uint32_t mtime = 0;
+};
+
+static std::uint32_t be32(const unsigned char *p)
+{
+  return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) | p[3];
+}
+
+static std::uint16_t be16(const unsigned char *p) { return std::uint16_t((p[0] << 8) | p[1]); }
+
+// Finds the git directory for `base`, following "gitdir:" files used by
+// worktrees and submodules. `worktree` receives the top of the checkout.
+static std::optional<fs::path> find_git_dir(const fs::path &base, fs::path &worktree)
+{
+  std::error_code ec;
+  for (fs::path dir = base; !dir.empty(); dir = dir.parent_path())
+  {
+    fs::path dotgit = dir / ".git";
+    if (fs::is_directory(dotgit, ec))
+    {
+      worktree = dir;
+      return dotgit;
+    }
+    if (fs::is_regular_file(dotgit, ec))
+    {
+      std::ifstream f(dotgit);
+      std::string line;
+      std::getline(f, line);
+      while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+        line.pop_back();
+      if (line.rfind("gitdir: ", 0) != 0)
+        return std::nullopt;
+      fs::path gd = line.substr(8);
+      worktree = dir;
+      return gd.is_absolute() ? gd : (dir / gd).lexically_normal();
+    }
+    if (dir == dir.parent_path())
+      break;
+  }
+  return std::nullopt;
+}
+
+// A linked worktree's git dir (.git/worktrees/<name>) has its own index but
+// shares config and info/exclude with the main repository, named by the
+// "commondir" file.
+static fs::path git_common_dir(const fs::path &git_dir)
+{
+  std::ifstream f(git_dir / "commondir");
+  std::string line;
+  if (!std::getline(f, line))
+    return git_dir;
+  while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+    line.pop_back();
+  if (line.empty())
+    return git_dir;
+  fs::path common = line;
+  return common.is_absolute() ? common : (git_dir / common).lexically_normal();
+}
+
+static std::size_t git_hash_size(const fs::path &git_dir)
+{
+  std::ifstream f(git_common_dir(git_dir) / "config");
+  std::string line;
+  while (std::getline(f, line))
+  {
+    std::string l = line;
+    l.erase(std::remove_if(l.begin(), l.end(), [](unsigned char c)
+                           { return std::isspace(c); }),
+            l.end());
+    std::transform(l.begin(), l.end(), l.begin(), ::tolower);
+    if (l == "objectformat=sha256")
+      return 32;
+  }
+  return 20;
+}
+
+static bool read_git_index(const fs::path &git_dir, std::vector<GitIndexEntry> &out)
+{
+  std::ifstream f(git_dir / "index", std::ios::binary);
+  if (!f)
+    return false;
+  std::vector<unsigned char> buf((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+  if (buf.size() < 12 || std::string(buf.begin(), buf.begin() + 4) != "DIRC")
+    return false;
+  std::uint32_t version = be32(&buf[4]);
+  std::uint32_t count = be32(&buf[8]);
+  if (version < 2 || version > 4)
+    return false;
+
+  const std::size_t hash = git_hash_size(git_dir);
+  const std::size_t fixed = 40 + hash + 2; // stat data, object id, flags
+  const unsigned char *p = buf.data() + 12;
+  const unsigned char *end = buf.data() + buf.size();
+  std::string prev;
+  out.reserve(count);
+
+  for (std::uint32_t i = 0; i < count; ++i)
+  {
+    if (end - p < (std::ptrdiff_t)fixed)
+      return false;
+    const unsigned char *entry = p;
+    std::uint32_t mtime = be32(entry + 8);
+    std::uint32_t mode = be32(entry + 24);
+    std::uint32_t size = be32(entry + 36);
+    std::uint16_t flags = be16(entry + 40 + hash);
+    bool skip_worktree = false;
+    p = entry + fixed;
+    if (flags & 0x4000)
+    {
+      if (version < 3 || end - p < 2)
+        return false;
+      skip_worktree = (be16(p) & 0x4000) != 0;
+      p += 2;
+    }
+
+    std::string path;
+    if (version == 4)
+    {
+      // Prefix compression: strip N bytes off the previous path, then append.
+      std::size_t strip = 0;
+      if (p >= end)
+        return false;
+      unsigned char c = *p++;
+      strip = c & 127;
+      while (c & 128)
+      {
+        if (p >= end)
+          return false;
+        c = *p++;
+        strip = ((strip + 1) << 7) | (c & 127);
+      }
+      if (strip > prev.size())
+        return false;
+      const unsigned char *nul = std::find(p, end, '\0');
+      if (nul == end)
+        return false;
+      path = prev.substr(0, prev.size() - strip) + std::string(p, nul);
+      p = nul + 1;
+    }
+    else
+    {
+      const unsigned char *nul = std::find(p, end, '\0');
+      if (nul == end)
+        return false;
+      path.assign(p, nul);
+      std::size_t len = (p - entry) + path.size();
+      p = entry + ((len + 8) & ~std::size_t(7));
+      if (p > end)
+        return false;
+    }
+    prev = path;
+
+    int stage = (flags >> 12) & 3;
+    if ((mode & 0170000) != 0100000 || skip_worktree)
+      continue;
+    if (stage > 1 && !out.empty() && out.back().path == path)
+      continue; // merge conflicts list the same path once per stage
+    out.push_back({std::move(path), size, mtime});
+  }
+  return true;
+}
+
+// Just enough of gitignore(5) to decide which untracked files git would show:
+// globs with * ? [] and **, negation, directory-only and anchored patterns.
+struct IgnoreRule
+{
+  std::string pattern;
+  std::string base; // directory of the .gitignore, relative to the work tree
+  bool negate = false;
+  bool dir_only = false;
+  bool anchored = false;
+};
+
+static bool glob_match(const char *p, const char *s)
+{
+  while (*p)
+  {
+    if (*p == '*')
+    {
+      if (p[1] == '*')
+      {
+        while (*p == '*')
+          ++p;
+        if (*p == '/')
+        {
+          ++p;
+          for (const char *t = s;;)
+          {
+            if (glob_match(p, t))
+              return true;
+            t = std::strchr(t, '/');
+            if (!t)
+              return false;
+            ++t;
+          }
+        }
+        for (const char *t = s;; ++t)
+        {
+          if (glob_match(p, t))
+            return true;
+          if (!*t)
+            return false;
+        }
+      }
+      ++p;
+      for (const char *t = s;; ++t)
+      {
+        if (glob_match(p, t))
+          return true;
+        if (!*t || *t == '/')
+          return false;
+      }
+    }
+    if (!*s)
+      return false;
+    if (*p == '?')
+    {
+      if (*s == '/')
+        return false;
+    }
+    else if (*p == '[')
+    {
+      const char *q = p + 1;
+      bool invert = (*q == '!' || *q == '^');
+      if (invert)
+        ++q;
+      bool hit = false;
+      bool first = true;
+      while (*q && (first || *q != ']'))
+      {
+        first = false;
+        char lo = *q, hi = *q;
+        if (q[1] == '-' && q[2] && q[2] != ']')
+        {
+          hi = q[2];
+          q += 2;
+        }
+        if (*s >= lo && *s <= hi)
+          hit = true;
+        ++q;
+      }
+      if (!*q || hit == invert || *s == '/')
+        return false;
+      p = q;
+    }
+    else
+    {
+      if (*p == '\\' && p[1])
+        ++p;
+      if (*p != *s)
+        return false;
+    }
+    ++p;
+    ++s;
+  }
+  return *s == '\0';
+}
+
+static void load_ignore_file(const fs::path &file, const std::string &base, std::vector<IgnoreRule> &rules)
+{
+  std::ifstream f(file);
+  std::string line;
+  while (std::getline(f, line))
+  {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    while (!line.empty() && line.back() == ' ' && (line.size() < 2 || line[line.size() - 2] != '\\'))
+      line.pop_back();
+    if (line.empty() || line[0] == '#')
+      continue;
+    IgnoreRule r;
+    r.base = base;
+    if (line[0] == '!')
+    {
+      r.negate = true;
+      line.erase(0, 1);
+    }
+    if (!line.empty() && line.back() == '/')
+    {
+      r.dir_only = true;
+      line.pop_back();
+    }
+    if (line.find('/') != std::string::npos)
+    {
+      r.anchored = true;
+      if (line[0] == '/')
+        line.erase(0, 1);
+    }
+    if (line.empty())
+      continue;
+    r.pattern = std::move(line);
+    rules.push_back(std::move(r));
+  }
+}
+
+static bool is_ignored(const std::vector<IgnoreRule> &rules, const std::string &rel, bool is_dir)
+{
+  std::string_view name = rel;
+  if (auto slash = rel.rfind('/'); slash != std::string::npos)
+    name.remove_prefix(slash + 1);
+  for (auto it = rules.rbegin(); it != rules.rend(); ++it)
+  {
+    const IgnoreRule &r = *it;
+    if (r.dir_only && !is_dir)
+      continue;
+    bool hit;
+    if (r.anchored)
+    {
+      if (!r.base.empty() && rel.compare(0, r.base.size() + 1, r.base + "/") != 0)
+        continue;
+      std::string sub = r.base.empty() ? rel : rel.substr(r.base.size() + 1);
+      hit = glob_match(r.pattern.c_str(), sub.c_str());
+    }
+    else
+      hit = glob_match(r.pattern.c_str(), std::string(name).c_str());
+    if (hit)
+      return !r.negate;
+  }
+  return false;
+}
+
+// Files under `start` that are neither tracked nor ignored. Ignored
+// directories are pruned, which is where the big untracked trees live.
+static void collect_untracked(const fs::path &worktree, const fs::path &git_dir, const fs::path &start,
+                              const std::unordered_set<std::string> &tracked, const WalkOptions &opts,
+                              const QueryFilter &filter, std::vector<Candidate> &out)
+{
+  std::vector<IgnoreRule> root_rules;
+  load_ignore_file(git_common_dir(git_dir) / "info" / "exclude", "", root_rules);
+
+  // Rules from the .gitignore files between the work tree and `start`.
+  std::string start_rel = start.lexically_relative(worktree).generic_string();
+  if (start_rel == ".")
+    start_rel.clear();
+  {
+    fs::path dir = worktree;
+    std::string rel;
+    load_ignore_file(dir / ".gitignore", rel, root_rules);
+    std::istringstream parts(start_rel);
+    std::string part;
+    while (std::getline(parts, part, '/'))
+    {
+      dir /= part;
+      rel = rel.empty() ? part : rel + "/" + part;
+      if (is_ignored(root_rules, rel, true))
+        return;
+      load_ignore_file(dir / ".gitignore", rel, root_rules);
+    }
+  }
+
+  struct Pending
+  {
+    fs::path dir;
+    std::string rel;
+    std::shared_ptr<const std::vector<IgnoreRule>> rules;
+    std::uint64_t dev;
+  };
+  DirGuard guard(opts);
+  std::uint64_t root_dev = 0;
+  if (!guard.enter(start, 0, root_dev))
+    return;
+  std::vector<Pending> stack;
+  stack.push_back({start, start_rel, std::make_shared<const std::vector<IgnoreRule>>(std::move(root_rules)), root_dev});
+
+  // Filters see paths relative to the search root, not the work tree.
+  const std::size_t root_off = start_rel.empty() ? 0 : start_rel.size() + 1;
+  std::error_code ec;
+  while (!stack.empty())
+  {
+    Pending cur = std::move(stack.back());
+    stack.pop_back();
+    if (cur.dir != start && fs::exists(cur.dir / ".gitignore", ec))
+    {
+      auto more = std::make_shared<std::vector<IgnoreRule>>(*cur.rules);
+      load_ignore_file(cur.dir / ".gitignore", cur.rel, *more);
+      cur.rules = std::move(more);
+    }
+    for (fs::directory_iterator it(cur.dir, fs::directory_options::skip_permission_denied, ec), end; it != end; it.increment(ec))
+    {
+      std::string name = it->path().filename().string();
+      std::string rel = cur.rel.empty() ? name : cur.rel + "/" + name;
+      bool dir = it->is_directory(ec) && !it->is_symlink(ec);
+      if (name == ".git" || (dir && opts.skips_dir(name)))
+        continue;
+      if (is_ignored(*cur.rules, rel, dir))
+        continue;
+      std::uint64_t dev = 0;
+      if (dir)
+      {
+        if (filter.may_contain("/" + rel.substr(root_off) + "/") && guard.enter(it->path(), cur.dev, dev))
+          stack.push_back({it->path(), rel, cur.rules, dev});
+      }
+      else if (!tracked.count(rel) && filter.wants_name(name) && filter.wants_path("/" + rel.substr(root_off)) &&
+               it->is_regular_file(ec))
+      {
+        std::uintmax_t size = it->file_size(ec);
+        if (!ec && filter.wants_size(size, name))
+          out.push_back({it->path(), size, 0});
+      }
+    }
+  }
+}
+
+static std::optional<std::vector<Candidate>> git_candidates(const fs::path &base, bool include_untracked,
+                                                            const QueryFilter &filter)
+{
+  fs::path worktree;
+  auto git_dir = find_git_dir(base, worktree);
+  if (!git_dir)
+    return std::nullopt;
+  std::vector<GitIndexEntry> entries;
+  if (!read_git_index(*git_dir, entries))
+    return std::nullopt;
+
+  std::string prefix = base.lexically_relative(worktree).generic_string();
+  if (prefix == ".")
+    prefix.clear();
+  else
+    prefix += "/";
+
+  WalkOptions opts = walk_options();
+  auto skipped = [&](const std::string &rel)
+  {
+    if (opts.skip_dirs.empty())
+      return false;
+    for (std::size_t from = 0, slash; (slash = rel.find('/', from)) != std::string::npos; from = slash + 1)
+      if (opts.skips_dir(rel.substr(from, slash - from)))
+        return true;
+    return false;
+  };
+
+  std::vector<Candidate> out;
+  std::unordered_set<std::string> tracked;
+  for (auto &e : entries)
+  {
+    if (e.path.compare(0, prefix.size(), prefix) != 0 || skipped(e.path))
+      continue;
+    if (include_untracked)
+      tracked.insert(e.path);
+    std::string rel = "/" + e.path.substr(prefix.size());
+    std::string name = rel.substr(rel.rfind('/') + 1);
+    if (!filter.wants_size(e.size, name) || !filter.wants_name(name) || !filter.wants_path(rel))
+      continue;
+    out.push_back({worktree / fs::path(e.path).make_preferred(), e.size, e.mtime});
+  }
+  if (include_untracked)
+    collect_untracked(worktree, *git_dir, base, tracked, opts, filter, out);
+  return out;
+}
+
+// ---- search workers -------------------------------------------------------
+// Files are read whole (they are capped at SIZE_CAP_BYTES) and matched in
+// memory. Reading is done either by the workers themselves with blocking I/O
+// or, on Linux, by an io_uring prefetcher that keeps many open/read/close
+// operations in flight and hands finished buffers to the workers.
+
+static bool read_file(const Candidate &c, std::string &out)
+{
+  std::ifstream f(c.path, std::ios::binary);
+  if (!f)
+    return false;
+  out.clear();
+  out.reserve((std::size_t)std::min<std::uintmax_t>(c.size + 1, SIZE_CAP_BYTES));
+  char buf[1 << 16];
+  while (out.size() < SIZE_CAP_BYTES && (f.read(buf, sizeof(buf)), f.gcount() > 0))
+    out.append(buf, (std::size_t)f.gcount());
+  if (out.size() > SIZE_CAP_BYTES)
+    out.resize(SIZE_CAP_BYTES);
+  return true;
+}
+
+// `q` is already lower case; reports the first line containing it.
+static std::optional<Match> match_buffer(const Candidate &c, std::string_view data, const std::string &q)
+{
+  if (data.empty())
+    return std::nullopt;
+  auto lower = [](char ch)
+  { return (char)std::tolower((unsigned char)ch); };
+  std::boyer_moore_horspool_searcher searcher(
+      q.begin(), q.end(),
+      [lower](char ch)
+      { return std::hash<char>()(lower(ch)); },
+      [lower](char a, char b)
+      { return lower(a) == lower(b); });
+  auto hit = std::search(data.begin(), data.end(), searcher);
+  if (hit == data.end())
+    return std::nullopt;
+
+  std::size_t pos = hit - data.begin();
+  std::size_t start = pos == 0 ? std::string_view::npos : data.rfind('\n', pos - 1);
+  start = (start == std::string_view::npos) ? 0 : start + 1;
+  std::size_t stop = data.find('\n', pos);
+  if (stop == std::string_view::npos)
+    stop = data.size();
+  int lineno = 1 + (int)std::count(data.begin(), data.begin() + start, '\n');
+  return Match{c.path, lineno, std::string(data.substr(start, stop - start))};
+}
+
+// ---- compressed files -----------------------------------------------------
+// With search_compressed, .gz files (and .zst ones when built with
+// DIRT_WITH_ZSTD) are decompressed on the search workers and streamed
+// through a fixed window into match_buffer, a block of whole lines at a
+// time, so a large log is never held in memory. Reported line numbers count
+// lines of the decompressed text.
+
+using ChunkSink = std::function<bool(const char *, std::size_t)>; // false = stop
+
+// Streaming inflate (RFC 1951) for gzip members (RFC 1952). Output goes to
+// the sink 32 KiB at a time; the CRC in the trailer is not checked.
+class Inflater
+{
+public:
+  explicit Inflater(std::istream &in) : in_(in), inbuf_(1 << 16), window_(2 * WINDOW) {}
+
+  // Returns false if the data is not gzip or is damaged; whatever was decoded
+  // before that point is still passed to the sink.
+  bool gunzip(const ChunkSink &sink)
+  {
+    sink_ = &sink;
+    try
+    {
+      for (bool first = true;; first = false)
+      {
+        // Concatenated members are one stream; anything else after the first
+        // member (often zero padding) ends it.
+        if (byte() != 0x1f || byte() != 0x8b || byte() != 8)
+          return !first;
+        int flags = byte();
+        for (int i = 0; i < 6; ++i) // mtime, xfl, os
+          byte();
+        if (flags & 4)
+        {
+          int len = byte();
+          len |= byte() << 8;
+          while (len-- > 0)
+            byte();
+        }
+        if (flags & 8) // file name
+          while (byte() > 0)
+            ;
+        if (flags & 16) // comment
+          while (byte() > 0)
+            ;
+        if (flags & 2) // header crc
+          byte(), byte();
+        if (!inflate())
+          return true;
+        for (int i = 0; i < 8; ++i) // crc32, input size
+          byte();
+      }
+    }
+    catch (...)
+    {
+      // Hand over what was decoded up to the damage, e.g. the tail of a log
+      // that is still being written.
+      try
+      {
+        flush();
+      }
+      catch (...)
+      {
+      }
+      return false;
+    }
+  }
+
+private:
+  static constexpr std::size_t WINDOW = 32 * 1024;
+  static constexpr int FAST_BITS = 9;
+
+  struct Huffman
+  {
+    std::uint16_t fast[1 << FAST_BITS]; // (length << 9) | symbol, 0 = slow path
+    std::uint16_t first_code[16];
+    std::uint32_t max_code[17];
+    std::uint16_t first_symbol[16];
+    std::uint8_t size[288];
+    std::uint16_t value[288];
+  };
+
+  static int reverse_bits(int v, int bits)
+  {
+    int r = 0;
+    for (int i = 0; i < bits; ++i, v >>= 1)
+      r = (r << 1) | (v & 1);
+    return r;
+  }
+
+  static void build(Huffman &h, const std::uint8_t *lengths, int n)
+  {
+    int sizes[17] = {}, next_code[16];
+    std::memset(h.fast, 0, sizeof(h.fast));
+    for (int i = 0; i < n; ++i)
+      ++sizes[lengths[i]];
+    sizes[0] = 0;
+    int code = 0, k = 0;
+    for (int i = 1; i < 16; ++i)
+    {
+      if (sizes[i] > (1 << i))
+        throw std::runtime_error("bad code lengths");
+      next_code[i] = code;
+      h.first_code[i] = (std::uint16_t)code;
+      h.first_symbol[i] = (std::uint16_t)k;
+      code += sizes[i];
+      if (sizes[i] && code - 1 >= (1 << i))
+        throw std::runtime_error("bad code lengths");
+      h.max_code[i] = (std::uint32_t)code << (16 - i);
+      code <<= 1;
+      k += sizes[i];
+    }
+    h.max_code[16] = 0x10000;
+    for (int i = 0; i < n; ++i)
+    {
+      int s = lengths[i];
+      if (!s)
+        continue;
+      int c = next_code[s] - h.first_code[s] + h.first_symbol[s];
+      h.size[c] = (std::uint8_t)s;
+      h.value[c] = (std::uint16_t)i;
+      if (s <= FAST_BITS)
+        for (int j = reverse_bits(next_code[s], s); j < (1 << FAST_BITS); j += 1 << s)
+          h.fast[j] = (std::uint16_t)((s << 9) | i);
+      ++next_code[s];
+    }
+  }
+
+  int raw()
+  {
+    if (in_pos_ == in_len_)
+    {
+      in_.read(inbuf_.data(), (std::streamsize)inbuf_.size());
+      in_len_ = (std::size_t)in_.gcount();
+      in_pos_ = 0;
+      if (in_len_ == 0)
+        return -1;
+    }
+    return (unsigned char)inbuf_[in_pos_++];
+  }
+
+  // Byte-aligned read that first drains whole bytes left in the bit buffer.
+  int byte()
+  {
+    if (nbits_ >= 8)
+    {
+      int b = (int)(bits_ & 0xff);
+      bits_ >>= 8;
+      nbits_ -= 8;
+      return b;
+    }
+    return raw();
+  }
+
+  void need(int n)
+  {
+    while (nbits_ < n)
+    {
+      int b = raw();
+      // Peeking a Huffman code may look a couple of bytes past the end.
+      if (b < 0 && ++overrun_ > 4)
+        throw std::runtime_error("truncated");
+      bits_ |= (std::uint64_t)(b < 0 ? 0 : b) << nbits_;
+      nbits_ += 8;
+    }
+  }
+
+  int take(int n)
+  {
+    need(n);
+    int v = (int)(bits_ & ((1u << n) - 1));
+    bits_ >>= n;
+    nbits_ -= n;
+    return v;
+  }
+
+  int decode(const Huffman &h)
+  {
+    need(16);
+    int b = h.fast[bits_ & ((1 << FAST_BITS) - 1)];
+    if (b)
+    {
+      bits_ >>= b >> 9;
+      nbits_ -= b >> 9;
+      return b & 511;
+    }
+    int k = reverse_bits((int)(bits_ & 0xffff), 16);
+    int s = FAST_BITS + 1;
+    while (s < 16 && (std::uint32_t)k >= h.max_code[s])
+      ++s;
+    if (s >= 16)
+      throw std::runtime_error("bad code");
+    int c = (k >> (16 - s)) - h.first_code[s] + h.first_symbol[s];
+    if (c >= 288 || h.size[c] != s)
+      throw std::runtime_error("bad code");
+    bits_ >>= s;
+    nbits_ -= s;
+    return h.value[c];
+  }
+
+  void put(char c)
+  {
+    window_[pos_++] = c;
+    if (pos_ == window_.size())
+    {
+      flush();
+      std::memmove(window_.data(), window_.data() + WINDOW, WINDOW);
+      pos_ = flushed_ = WINDOW;
+    }
+  }
+
+  // need() pads with zero bytes past the end of the input; output decoded
+  // from those would be garbage.
+  void check_input() const
+  {
+    if (nbits_ < 8 * overrun_)
+      throw std::runtime_error("truncated");
+  }
+
+  void flush()
+  {
+    if (pos_ > flushed_ && !stop_ && !(*sink_)(window_.data() + flushed_, pos_ - flushed_))
+      stop_ = true;
+    flushed_ = pos_;
+  }
+
+  void stored()
+  {
+    bits_ >>= nbits_ % 8;
+    nbits_ -= nbits_ % 8;
+    int len = take(16), nlen = take(16);
+    if (len != (~nlen & 0xffff))
+      throw std::runtime_error("bad stored block");
+    while (len-- > 0 && !stop_)
+    {
+      int b = byte();
+      if (b < 0)
+        throw std::runtime_error("truncated");
+      check_input();
+      put((char)b);
+    }
+  }
+
+  void codes(const Huffman &lit, const Huffman &dist)
+  {
+    static const std::uint16_t len_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27,
+                                               31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const std::uint8_t len_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                               2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const std::uint16_t dist_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                                193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const std::uint8_t dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                                6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    while (!stop_)
+    {
+      int sym = decode(lit);
+      check_input();
+      if (sym < 256)
+      {
+        put((char)sym);
+        continue;
+      }
+      if (sym == 256)
+        return;
+      sym -= 257;
+      if (sym >= 29)
+        throw std::runtime_error("bad length");
+      int len = len_base[sym] + take(len_extra[sym]);
+      int d = decode(dist);
+      if (d >= 30)
+        throw std::runtime_error("bad distance");
+      std::size_t back = dist_base[d] + (std::size_t)take(dist_extra[d]);
+      check_input();
+      if (back > pos_)
+        throw std::runtime_error("bad distance");
+      while (len-- > 0)
+        put(window_[pos_ - back]);
+    }
+  }
+
+  void dynamic()
+  {
+    static const std::uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    int nlit = take(5) + 257, ndist = take(5) + 1, nclen = take(4) + 4;
+    if (nlit > 286 || ndist > 30)
+      throw std::runtime_error("bad code counts");
+    std::uint8_t clen[19] = {};
+    for (int i = 0; i < nclen; ++i)
+      clen[order[i]] = (std::uint8_t)take(3);
+    Huffman lengths;
+    build(lengths, clen, 19);
+
+    std::uint8_t lens[286 + 32] = {};
+    for (int n = 0; n < nlit + ndist;)
+    {
+      int sym = decode(lengths);
+      int repeat = 1;
+      std::uint8_t fill = 0;
+      if (sym < 16)
+        fill = (std::uint8_t)sym;
+      else if (sym == 16)
+      {
+        if (n == 0)
+          throw std::runtime_error("bad repeat");
+        fill = lens[n - 1];
+        repeat = 3 + take(2);
+      }
+      else if (sym == 17)
+        repeat = 3 + take(3);
+      else if (sym == 18)
+        repeat = 11 + take(7);
+      else
+        throw std::runtime_error("bad code lengths");
+      if (n + repeat > nlit + ndist)
+        throw std::runtime_error("bad code lengths");
+      while (repeat-- > 0)
+        lens[n++] = fill;
+    }
+    build(lit_, lens, nlit);
+    build(dist_, lens + nlit, ndist);
+  }
+
+  // One deflate stream; false if the sink asked to stop.
+  bool inflate()
+  {
+    for (bool last = false; !last && !stop_;)
+    {
+      last = take(1) != 0;
+      int type = take(2);
+      if (type == 0)
+        stored();
+      else if (type == 1)
+      {
+        if (!have_fixed_)
+        {
+          std::uint8_t lens[288 + 32];
+          std::fill(lens, lens + 144, 8);
+          std::fill(lens + 144, lens + 256, 9);
+          std::fill(lens + 256, lens + 280, 7);
+          std::fill(lens + 280, lens + 288, 8);
+          std::fill(lens + 288, lens + 320, 5);
+          build(fixed_lit_, lens, 288);
+          build(fixed_dist_, lens + 288, 32);
+          have_fixed_ = true;
+        }
+        codes(fixed_lit_, fixed_dist_);
+      }
+      else if (type == 2)
+      {
+        dynamic();
+        codes(lit_, dist_);
+      }
+      else
+        throw std::runtime_error("bad block type");
+    }
+    bits_ >>= nbits_ % 8;
+    nbits_ -= nbits_ % 8;
+    flush();
+    return !stop_;
+  }
+
+  std::istream &in_;
+  std::vector<char> inbuf_;
+  std::size_t in_pos_ = 0, in_len_ = 0;
+  std::uint64_t bits_ = 0;
+  int nbits_ = 0;
+  int overrun_ = 0;
+
+  std::vector<char> window_; // last WINDOW bytes of history + WINDOW of new output
+  std::size_t pos_ = 0, flushed_ = 0;
+  const ChunkSink *sink_ = nullptr;
+  bool stop_ = false;
+
+  Huffman lit_, dist_, fixed_lit_, fixed_dist_;
+  bool have_fixed_ = false;
+};
+
+#if defined(DIRT_WITH_ZSTD)
+static bool unzstd(std::istream &in, const ChunkSink &sink)
+{
+  ZSTD_DStream *ds = ZSTD_createDStream();
+  if (!ds)
+    return false;
+  ZSTD_initDStream(ds);
+  std::vector<char> inbuf(ZSTD_DStreamInSize()), outbuf(ZSTD_DStreamOutSize());
+  bool ok = true, more = true;
+  while (ok && more && (in.read(inbuf.data(), (std::streamsize)inbuf.size()), in.gcount() > 0))
+  {
+    ZSTD_inBuffer input{inbuf.data(), (std::size_t)in.gcount(), 0};
+    bool full = false;
+    while (more && (input.pos < input.size || full))
+    {
+      ZSTD_outBuffer output{outbuf.data(), outbuf.size(), 0};
+      std::size_t r = ZSTD_decompressStream(ds, &output, &input);
+      if (ZSTD_isError(r))
+      {
+        ok = false;
+        break;
+      }
+      full = output.pos == output.size;
+      if (output.pos > 0 && !sink(outbuf.data(), output.pos))
+        more = false;
+    }
+  }
+  ZSTD_freeDStream(ds);
+  return ok;
+}
+#endif
+
+// Gathers decompressed chunks into whole lines and matches them a block at
+// a time, carrying the line count from block to block.
+class StreamMatcher
+{
+public:
+  StreamMatcher(const Candidate &c, const std::string &q, std::uintmax_t limit) : c_(c), q_(q), limit_(limit) {}
+
+  bool feed(const char *p, std::size_t n)
+  {
+    seen_ += n;
+    pending_.append(p, n);
+    std::size_t end = pending_.rfind('\n');
+    if (end == std::string::npos)
+    {
+      if (pending_.size() >= LONG_LINE)
+      {
+        // One enormous line: search it now and keep just enough of its tail
+        // to catch a match that straddles the cut.
+        if (check(pending_))
+          return false;
+        pending_.erase(0, pending_.size() - std::min(pending_.size(), q_.size() - 1));
+      }
+      return seen_ < limit_;
+    }
+    std::string_view block(pending_.data(), end + 1);
+    if (check(block))
+      return false;
+    lines_ += (int)std::count(block.begin(), block.end(), '\n');
+    pending_.erase(0, end + 1);
+    return seen_ < limit_;
+  }
+
+  std::optional<Match> finish()
+  {
+    if (!result_ && !pending_.empty())
+      check(pending_);
+    return std::move(result_);
+  }
+
+private:
+  static constexpr std::size_t LONG_LINE = 1 << 20;
+
+  bool check(std::string_view block)
+  {
+    auto m = match_buffer(c_, block, q_);
+    if (!m)
+      return false;
+    m->line += lines_;
+    result_ = std::move(m);
+    return true;
+  }
+
+  const Candidate &c_;
+  const std::string &q_;
+  std::uintmax_t limit_;
+  std::uintmax_t seen_ = 0;
+  std::string pending_;
+  int lines_ = 0;
+  std::optional<Match> result_;
+};
+
+// Stops after `limit` decompressed bytes.
+static std::optional<Match> match_compressed(const Candidate &c, const std::string &q, std::uintmax_t limit)
+{
+  std::ifstream f(c.path, std::ios::binary);
+  if (!f)
+    return std::nullopt;
+  StreamMatcher matcher(c, q, limit);
+  ChunkSink sink = [&](const char *p, std::size_t n)
+  { return matcher.feed(p, n); };
+  switch (compression_of(c.path.filename().string()))
+  {
+  case Compression::Gzip:
+    Inflater(f).gunzip(sink);
+    break;
+#if defined(DIRT_WITH_ZSTD)
+  case Compression::Zstd:
+    unzstd(f, sink);
+    break;
+#endif
+  default:
+    return std::nullopt;
+  }
+  return matcher.finish();
+}
+
+static unsigned search_threads()
+{
+  unsigned n = std::thread::hardware_concurrency();
+  return std::clamp(n, 1u, 16u);
+}
+
+// A file the prefetcher has read, or one it gave up on (`loaded` false) that
+// the worker should read itself.
+struct ReadyFile
+{
+  std::size_t index = 0;
+  std::string data;
+  bool loaded = false;
+};
+
+// Bounded so the prefetcher can't run arbitrarily far ahead of the matchers.
+class ReadyQueue
+{
+public:
+  explicit ReadyQueue(std::size_t cap) : cap_(cap) {}
+
+  void push(ReadyFile f)
+  {
+    std::unique_lock<std::mutex> lock(m_);
+    not_full_.wait(lock, [&]
+                   { return q_.size() < cap_; });
+    q_.push_back(std::move(f));
+    not_empty_.notify_one();
+  }
+
+  bool pop(ReadyFile &out)
+  {
+    std::unique_lock<std::mutex> lock(m_);
+    not_empty_.wait(lock, [&]
+                    { return !q_.empty() || closed_; });
+    if (q_.empty())
+      return false;
+    out = std::move(q_.front());
+    q_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    closed_ = true;
+    not_empty_.notify_all();
+  }
+
+private:
+  std::mutex m_;
+  std::condition_variable not_empty_, not_full_;
+  std::deque<ReadyFile> q_;
+  std::size_t cap_;
+  bool closed_ = false;
+};
+
+#if DIRT_HAVE_IO_URING
+
+// Minimal raw io_uring wrapper; no liburing dependency.
+class IoUring
+{
+public:
+  ~IoUring()
+  {
+    if (sqes_)
+      munmap(sqes_, sqes_size_);
+    if (cq_ptr_ && cq_ptr_ != sq_ptr_)
+      munmap(cq_ptr_, cq_size_);
+    if (sq_ptr_)
+      munmap(sq_ptr_, sq_size_);
+    if (fd_ >= 0)
+      ::close(fd_);
+  }
+
+  bool init(unsigned entries)
+  {
+    io_uring_params p{};
+    fd_ = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (fd_ < 0)
+      return false;
+    sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED)
+    {
+      sq_ptr_ = nullptr;
+      return false;
+    }
+    cq_ptr_ = single ? sq_ptr_ : mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq_ptr_ == MAP_FAILED)
+    {
+      cq_ptr_ = nullptr;
+      return false;
+    }
+    sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+    void *s = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (s == MAP_FAILED)
+      return false;
+    sqes_ = (io_uring_sqe *)s;
+
+    char *sq = (char *)sq_ptr_, *cq = (char *)cq_ptr_;
+    sq_head_ = (unsigned *)(sq + p.sq_off.head);
+    sq_tail_ = (unsigned *)(sq + p.sq_off.tail);
+    sq_mask_ = *(unsigned *)(sq + p.sq_off.ring_mask);
+    sq_array_ = (unsigned *)(sq + p.sq_off.array);
+    cq_head_ = (unsigned *)(cq + p.cq_off.head);
+    cq_tail_ = (unsigned *)(cq + p.cq_off.tail);
+    cq_mask_ = *(unsigned *)(cq + p.cq_off.ring_mask);
+    cqes_ = (io_uring_cqe *)(cq + p.cq_off.cqes);
+    sq_entries_ = p.sq_entries;
+    tail_ = *sq_tail_;
+    return supports({IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE});
+  }
+
+  io_uring_sqe *get_sqe()
+  {
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (tail_ - head >= sq_entries_)
+      return nullptr;
+    unsigned idx = tail_ & sq_mask_;
+    io_uring_sqe *sqe = &sqes_[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[idx] = idx;
+    ++tail_;
+    ++pending_;
+    return sqe;
+  }
+
+  bool submit(unsigned wait_nr)
+  {
+    __atomic_store_n(sq_tail_, tail_, __ATOMIC_RELEASE);
+    for (;;)
+    {
+      int r = (int)syscall(__NR_io_uring_enter, fd_, pending_, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+      if (r >= 0)
+      {
+        pending_ -= std::min<unsigned>(pending_, (unsigned)r);
+        in_flight_ += (unsigned)r;
+        return true;
+      }
+      if (errno == EINTR)
+        continue;
+      // Completion queue is backed up; the caller reaps and tries again.
+      return errno == EAGAIN || errno == EBUSY;
+    }
+  }
+
+  bool peek(io_uring_cqe &out)
+  {
+    unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+      return false;
+    out = cqes_[head & cq_mask_];
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    if (in_flight_)
+      --in_flight_;
+    return true;
+  }
+
+  // Blocks until a completion is posted; false if the ring can't wait.
+  bool wait()
+  {
+    for (;;)
+    {
+      if ((int)syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) >= 0)
+        return true;
+      if (errno != EINTR)
+        return false;
+    }
+  }
+
+  // Submitted requests whose completions haven't been reaped yet.
+  unsigned in_flight() const { return in_flight_; }
+
+  // Takes back the queued entries the kernel hasn't consumed, passing each
+  // to `each` so the caller can release what it refers to.
+  template <typename F>
+  void discard_unsubmitted(F each)
+  {
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    for (unsigned i = head; i != tail_; ++i)
+      each(sqes_[sq_array_[i & sq_mask_]]);
+    tail_ = head;
+    pending_ = 0;
+    __atomic_store_n(sq_tail_, tail_, __ATOMIC_RELEASE);
+  }
+
+private:
+  bool supports(std::initializer_list<int> ops)
+  {
+    std::vector<char> buf(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+    auto *probe = (io_uring_probe *)buf.data();
+    if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, 256) < 0)
+      return false;
+    for (int op : ops)
+      if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+        return false;
+    return true;
+  }
+
+  int fd_ = -1;
+  void *sq_ptr_ = nullptr, *cq_ptr_ = nullptr;
+  std::size_t sq_size_ = 0, cq_size_ = 0, sqes_size_ = 0;
+  io_uring_sqe *sqes_ = nullptr;
+  io_uring_cqe *cqes_ = nullptr;
+  unsigned *sq_head_ = nullptr, *sq_tail_ = nullptr, *sq_array_ = nullptr;
+  unsigned *cq_head_ = nullptr, *cq_tail_ = nullptr;
+  unsigned sq_mask_ = 0, cq_mask_ = 0, sq_entries_ = 0;
+  unsigned tail_ = 0, pending_ = 0, in_flight_ = 0;
+};
+
+// Keeps up to `depth` files moving through openat -> read -> close and pushes
+// each finished buffer to `ready`. Returns false without touching `ready` if
+// io_uring can't be set up, so the caller can use the blocking path instead.
+class UringPrefetcher
+{
+public:
+  UringPrefetcher(const std::vector<Candidate> &cands, unsigned depth, bool stream_compressed)
+      : cands_(cands), slots_(depth), stream_compressed_(stream_compressed) {}
+
+  bool init() { return ring_.init((unsigned)slots_.size() * 2); }
+
+  void run(ReadyQueue &ready)
+  {
+    std::vector<std::size_t> free_slots;
+    for (std::size_t s = slots_.size(); s-- > 0;)
+      free_slots.push_back(s);
+    std::size_t next = 0;
+    bool ok = true;
+
+    while (ok && (next < cands_.size() || free_slots.size() < slots_.size() || closes_ > 0))
+    {
+      while (next < cands_.size() && !free_slots.empty())
+      {
+        // Compressed files are streamed by the workers, not read whole.
+        if (stream_compressed_ && compression_of(cands_[next].path.filename().string()) != Compression::None)
+        {
+          ready.push({next++, {}, false});
+          continue;
+        }
+        std::size_t s = free_slots.back();
+        Slot &slot = slots_[s];
+        slot = Slot{};
+        slot.index = next++;
+        slot.busy = true;
+        if (!queue_open(s))
+        {
+          slot.busy = false;
+          --next;
+          break;
+        }
+        free_slots.pop_back();
+      }
+      if (!ring_.submit(1))
+      {
+        ok = false;
+        break;
+      }
+      io_uring_cqe cqe;
+      while (ring_.peek(cqe))
+      {
+        std::uint64_t tag = cqe.user_data;
+        if (tag == CLOSE_TAG)
+        {
+          --closes_;
+          continue;
+        }
+        std::size_t s = (std::size_t)tag;
+        if (!step(s, cqe.res, ready))
+        {
+          slots_[s].busy = false;
+          free_slots.push_back(s);
+        }
+      }
+    }
+
+    if (!ok)
+    {
+      // The ring broke, but what it already took keeps running and writes
+      // into the slot buffers, so wait for all of it before handing the
+      // files back to the workers. Late opens leave their fd in the slot.
+      ring_.discard_unsubmitted([](const io_uring_sqe &sqe)
+                                {
+                                  if (sqe.opcode == IORING_OP_CLOSE)
+                                    ::close(sqe.fd); });
+      io_uring_cqe cqe;
+      while (ring_.in_flight() > 0)
+      {
+        if (!ring_.peek(cqe))
+        {
+          if (!ring_.wait())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          continue;
+        }
+        if (cqe.user_data == CLOSE_TAG)
+          continue;
+        Slot &slot = slots_[(std::size_t)cqe.user_data];
+        if (slot.fd < 0 && cqe.res >= 0)
+          slot.fd = cqe.res;
+      }
+      for (auto &slot : slots_)
+        if (slot.busy)
+        {
+          if (slot.fd >= 0)
+            ::close(slot.fd);
+          ready.push({slot.index, {}, false});
+        }
+      for (; next < cands_.size(); ++next)
+        ready.push({next, {}, false});
+    }
+  }
+
+private:
+  static constexpr std::uint64_t CLOSE_TAG = ~std::uint64_t(0);
+
+  struct Slot
+  {
+    std::size_t index = 0;
+    int fd = -1;
+    bool busy = false;
+    std::string buf;
+    std::size_t got = 0;
+  };
+
+  bool queue_open(std::size_t s)
+  {
+    io_uring_sqe *sqe = ring_.get_sqe();
+    if (!sqe)
+      return false;
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (std::uint64_t)(uintptr_t)cands_[slots_[s].index].path.c_str();
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    sqe->user_data = s;
+    return true;
+  }
+
+  bool queue_read(std::size_t s)
+  {
+    Slot &slot = slots_[s];
+    io_uring_sqe *sqe = ring_.get_sqe();
+    if (!sqe)
+      return false;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = slot.fd;
+    sqe->addr = (std::uint64_t)(uintptr_t)(slot.buf.data() + slot.got);
+    sqe->len = (unsigned)(slot.buf.size() - slot.got);
+    sqe->off = slot.got;
+    sqe->user_data = s;
+    return true;
+  }
+
+  void queue_close(int fd)
+  {
+    io_uring_sqe *sqe = ring_.get_sqe();
+    if (!sqe)
+    {
+      ::close(fd);
+      return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = CLOSE_TAG;
+    ++closes_;
+  }
+
+  // Advances a slot after a completion. Returns true while the file is still
+  // in flight, false once it has been handed off and the slot is free.
+  bool step(std::size_t s, int res, ReadyQueue &ready)
+  {
+    Slot &slot = slots_[s];
+    if (slot.fd < 0)
+    {
+      if (res < 0)
+        return false; // unreadable; the blocking path would skip it too
+      slot.fd = res;
+      // One byte of slack so a file that grew since it was listed shows up
+      // as a full read rather than silently truncated.
+      std::uintmax_t want = std::min<std::uintmax_t>(cands_[slot.index].size + 1, SIZE_CAP_BYTES);
+      slot.buf.resize((std::size_t)std::max<std::uintmax_t>(want, 1));
+      if (queue_read(s))
+        return true;
+      ready.push({slot.index, {}, false});
+      queue_close(slot.fd);
+      return false;
+    }
+    if (res < 0)
+    {
+      queue_close(slot.fd);
+      return false;
+    }
+    slot.got += (std::size_t)res;
+    if (res > 0 && slot.got == slot.buf.size() && slot.buf.size() < SIZE_CAP_BYTES)
+    {
+      slot.buf.resize((std::size_t)std::min<std::uintmax_t>(slot.buf.size() * 2, SIZE_CAP_BYTES));
+      if (queue_read(s))
+        return true;
+    }
+    slot.buf.resize(slot.got);
+    queue_close(slot.fd);
+    ready.push({slot.index, std::move(slot.buf), true});
+    return false;
+  }
+
+  const std::vector<Candidate> &cands_;
+  std::vector<Slot> slots_;
+  bool stream_compressed_;
+  IoUring ring_;
+  std::size_t closes_ = 0;
+};
+
+#endif
+
+// Results keep the candidate order, whichever worker finished first.
+// `hits`, if given, receives the candidates that matched.
+static std::vector<Match> scan_candidates(const std::vector<Candidate> &cands, const std::string &q,
+                                          std::vector<Candidate> *hits = nullptr)
+{
+  std::vector<std::optional<Match>> found(cands.size());
+  std::vector<std::thread> pool;
+  unsigned threads = search_threads();
+  std::uintmax_t stream_limit = 0;
+  if (config_flag("search_compressed", false))
+    stream_limit = parse_size(read_config_value("compressed_limit").value_or("")).value_or(DEFAULT_COMPRESSED_LIMIT);
+
+  // `data` is the file's contents when the prefetcher already read them.
+  auto scan = [&](std::size_t i, std::string &data, bool loaded) -> std::optional<Match>
+  {
+    if (stream_limit && compression_of(cands[i].path.filename().string()) != Compression::None)
+      return match_compressed(cands[i], q, stream_limit);
+    if (loaded || read_file(cands[i], data))
+      return match_buffer(cands[i], data, q);
+    return std::nullopt;
+  };
+
+#if DIRT_HAVE_IO_URING
+  std::string backend = to_lower_copy(read_config_value("io_backend").value_or("auto"));
+  unsigned depth = (unsigned)std::clamp<std::uintmax_t>(parse_size(read_config_value("io_depth").value_or("")).value_or(64), 1, 1024);
+  std::unique_ptr<UringPrefetcher> prefetch;
+  if (backend == "io_uring" || (backend == "auto" && cands.size() >= 32))
+  {
+    prefetch = std::make_unique<UringPrefetcher>(cands, depth, stream_limit > 0);
+    if (!prefetch->init())
+      prefetch.reset();
+  }
+  if (prefetch)
+  {
+    ReadyQueue ready(depth * 2);
+    std::thread reader([&]
+                       { prefetch->run(ready); ready.close(); });
+    auto work = [&]
+    {
+      ReadyFile f;
+      std::string data;
+      while (ready.pop(f))
+        found[f.index] = f.loaded ? scan(f.index, f.data, true) : scan(f.index, data, false);
+    };
+    for (unsigned t = 1; t < threads; ++t)
+      pool.emplace_back(work);
+    work();
+    reader.join();
+  }
+  else
+#endif
+  {
+    std::atomic<std::size_t> next{0};
+    auto work = [&]
+    {
+      std::string data;
+      for (std::size_t i; (i = next++) < cands.size();)
+        found[i] = scan(i, data, false);
+    };
+    for (unsigned t = 1; t < threads; ++t)
+      pool.emplace_back(work);
+    work();
+  }
+  for (auto &t : pool)
+    t.join();
+
+  std::vector<Match> results;
+  for (std::size_t i = 0; i < found.size(); ++i)
+    if (found[i])
+    {
+      results.push_back(std::move(*found[i]));
+      if (hits)
+        hits->push_back(cands[i]);
+    }
+  return results;
+}
+
+static std::vector<Match> find_in_files(const fs::path &base, const std::string &query,
+                                        std::vector<Candidate> *hits = nullptr)
+{
+  QueryFilter filter = parse_query(query);
+  if (!filter.text.empty())
+    limit_reads(filter);
+  std::optional<std::vector<Candidate>> cands;
+  if (config_flag("search_git_index", false))
+    cands = git_candidates(base, config_flag("search_untracked", false), filter);
+  if (!cands)
+    cands = walk_candidates(base, filter);
+  if (!filter.text.empty())
+    return scan_candidates(*cands, filter.text, hits);
+
+  // Filters alone just list the files they let through, without opening any.
+  std::vector<Match> results;
+  for (auto &c : *cands)
+    results.push_back({c.path, 0, ""});
+  if (hits)
+    *hits = std::move(*cands);
+  return results;
+}
+
+// ---- search cache ---------------------------------------------------------
+// Searches from this session, keyed on (root, query, tree generation). A
+// query that contains an earlier one can only match files the earlier one
+// matched, so only those are read again. The generation is bumped whenever
+// files may have changed under us (refresh, returning from the editor).
+
+struct SearchCacheEntry
+{
+  fs::path root;
+  std::uint64_t generation = 0;
+  std::string filters; // QueryFilter::canonical
+  std::string text;    // QueryFilter::text
+  std::vector<Match> matches;
+  std::vector<Candidate> files;
+};
+
+static constexpr std::size_t SEARCH_CACHE_ENTRIES = 32;
+static std::uint64_t tree_generation = 0;
+static std::list<SearchCacheEntry> search_cache; // front = most recent
+
+// Match lines are "M <line> <size> <file> <preview>".
+static std::optional<std::vector<Match>> daemon_search(const fs::path &base, const std::string &query,
+                                                       std::vector<Candidate> &files)
+{
+#if defined(_WIN32)
+  (void)base;
+  (void)query;
+  (void)files;
+  return std::nullopt;
+#else
+  auto reply = daemon_request("SEARCH " + escape_field(base.string()) + " " + escape_field(query));
+  if (!reply)
+    return std::nullopt;
+  std::vector<Match> out;
+  for (auto &line : *reply)
+  {
+    std::istringstream ls(line);
+    std::string tag, file, preview;
+    Match m;
+    Candidate c;
+    if (ls >> tag >> m.line >> c.size >> file && tag == "M")
+    {
+      ls >> preview;
+      auto path = unescape_field(file);
+      auto text = unescape_field(preview);
+      if (!path || !text)
+        continue;
+      m.file = c.path = std::move(*path);
+      m.preview = std::move(*text);
+      out.push_back(std::move(m));
+      files.push_back(std::move(c));
+    }
+  }
+  return out;
+#endif
+}
+
+// What the cache can do for a query: answer it outright, or narrow it to
+// the files an earlier, shorter query matched. Planning and storing touch
+// the cache; running the search does not, so the daemon can scan without
+// holding its lock.
+struct SearchPlan
+{
+  QueryFilter filter;
+  std::uint64_t generation = 0;
+  std::optional<std::vector<Match>> hit;
+  std::optional<std::vector<Candidate>> refine;
+};
+
+static SearchPlan plan_search(const fs::path &base, const std::string &query)
+{
+  SearchPlan plan;
+  plan.filter = parse_query(query);
+  if (!plan.filter.text.empty())
+    limit_reads(plan.filter);
+  plan.generation = tree_generation;
+  auto refine = search_cache.end();
+  for (auto it = search_cache.begin(); it != search_cache.end(); ++it)
+  {
+    if (it->root != base || it->generation != tree_generation || it->filters != plan.filter.canonical)
+      continue;
+    if (it->text == plan.filter.text)
+    {
+      search_cache.splice(search_cache.begin(), search_cache, it);
+      plan.hit = it->matches;
+      return plan;
+    }
+    if (plan.filter.text.find(it->text) != std::string::npos &&
+        (refine == search_cache.end() || it->text.size() > refine->text.size()))
+      refine = it;
+  }
+  if (refine != search_cache.end())
+    plan.refine = refine->files;
+  return plan;
+}
+
+static SearchCacheEntry run_search(const fs::path &base, const std::string &query, const SearchPlan &plan)
+{
+  SearchCacheEntry entry{base, plan.generation, plan.filter.canonical, plan.filter.text, {}, {}};
+  if (plan.refine)
+  {
+    // A filters-only listing may hold files too big to search.
+    std::vector<Candidate> files;
+    for (auto &c : *plan.refine)
+      if (plan.filter.wants_size(c.size, c.path.filename().string()))
+        files.push_back(c);
+    entry.matches = scan_candidates(files, plan.filter.text, &entry.files);
+  }
+  else
+    entry.matches = find_in_files(base, query, &entry.files);
+  return entry;
+}
+
+static void store_search(SearchCacheEntry entry)
+{
+  search_cache.push_front(std::move(entry));
+  if (search_cache.size() > SEARCH_CACHE_ENTRIES)
+    search_cache.pop_back();
+}
+
+static std::vector<Match> cached_search(const fs::path &base, const std::string &query)
+{
+  SearchPlan plan = plan_search(base, query);
+  if (plan.hit)
+    return std::move(*plan.hit);
+
+  SearchCacheEntry entry{base, plan.generation, plan.filter.canonical, plan.filter.text, {}, {}};
+  if (auto remote = daemon_search(base, query, entry.files))
+    entry.matches = std::move(*remote);
+  else
+    entry = run_search(base, query, plan);
+  std::vector<Match> matches = entry.matches;
+  store_search(std::move(entry));
+  return matches;
+}
+
+#if !defined(_WIN32)
+
+// ---- daemon ---------------------------------------------------------------
+
+class DirtDaemon
+{
+public:
+  int run()
+  {
+    std::signal(SIGPIPE, SIG_IGN);
+    socket_path_ = daemon_socket_path();
+    int probe = connect_unix(socket_path_);
+    if (probe >= 0)
+    {
+      ::close(probe);
+      std::cerr << "dirt: a daemon is already listening on " << socket_path_ << "\n";
+      return 1;
+    }
+
+    sockaddr_un addr{};
+    if (socket_path_.size() >= sizeof(addr.sun_path))
+      return 1;
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, socket_path_.c_str(), socket_path_.size() + 1);
+    ::unlink(socket_path_.c_str());
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    mode_t old_mask = ::umask(077);
+    bool bound = listener >= 0 && ::bind(listener, (sockaddr *)&addr, sizeof(addr)) == 0;
+    ::umask(old_mask);
+    if (!bound || ::listen(listener, 16) != 0)
+    {
+      std::cerr << "dirt: cannot listen on " << socket_path_ << "\n";
+      return 1;
+    }
+    active_socket = socket_path_;
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    max_watches_ = (std::size_t)parse_size(read_config_value("daemon_max_watches").value_or("")).value_or(65536);
+#if defined(__linux__)
+    inotify_ = inotify_init1(IN_CLOEXEC);
+    if (inotify_ >= 0)
+      std::thread([this]
+                  { pump_events(); })
+          .detach();
+#endif
+    std::cerr << "dirt: daemon listening on " << socket_path_ << "\n";
+
+    for (;;)
+    {
+      int fd = ::accept(listener, nullptr, nullptr);
+      if (fd < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        break;
+      }
+      if (!peer_is_us(fd))
+      {
+        ::close(fd);
+        continue;
+      }
+      std::thread([this, fd]
+                  { serve(fd); })
+          .detach();
+    }
+    ::unlink(socket_path_.c_str());
+    return 0;
+  }
+
+private:
+  struct CachedListing
+  {
+    std::vector<EntryMeta> entries;
+    std::int64_t stamp = 0;
+    bool watched = false;
+  };
+
+  static inline std::string active_socket;
+
+  static void on_signal(int)
+  {
+    ::unlink(active_socket.c_str());
+    std::_Exit(0);
+  }
+
+  static std::int64_t dir_stamp(const fs::path &dir)
+  {
+    std::error_code ec;
+    return (std::int64_t)fs::last_write_time(dir, ec).time_since_epoch().count();
+  }
+
+  void serve(int fd)
+  {
+    LineSocket conn(fd);
+    std::string line;
+    while (conn.read_line(line))
+    {
+      std::istringstream ls(line);
+      std::string cmd, a, b;
+      ls >> cmd >> a >> b;
+      std::string reply;
+      auto arg = unescape_field(a), query = unescape_field(b);
+      if (!arg || !query)
+      {
+        conn.write_all("ERR bad request\n");
+        continue;
+      }
+      if (cmd == "LIST")
+        reply = list(*arg);
+      else if (cmd == "SEARCH")
+      {
+        // A big search can outlast the client's receive timeout, so say
+        // we're still working every second until the reply is ready.
+        auto job = std::async(std::launch::async, [&]
+                              { return search(*arg, *query); });
+        while (job.wait_for(std::chrono::seconds(1)) != std::future_status::ready)
+          if (!conn.write_all(".\n"))
+            break;
+        reply = job.get();
+      }
+      else if (cmd == "PING")
+        reply = "";
+      else
+      {
+        conn.write_all("ERR unknown request\n");
+        continue;
+      }
+      if (!conn.write_all(reply + "END\n"))
+        break;
+    }
+  }
+
+  std::string list(const fs::path &dir)
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    const std::string key = dir.string();
+    auto it = listings_.find(key);
+    if (it == listings_.end() || (!it->second.watched && it->second.stamp != dir_stamp(dir)))
+    {
+      CachedListing fresh;
+      fresh.stamp = dir_stamp(dir);
+      fresh.entries = list_directory_local(dir);
+      fresh.watched = watch(dir);
+      it = listings_.insert_or_assign(key, std::move(fresh)).first;
+    }
+    std::string reply;
+    for (auto &e : it->second.entries)
+      reply += format_entry(e) + "\n";
+    return reply;
+  }
+
+  // m_ guards the cache but is not held while files are scanned, so other
+  // clients' listings don't wait behind a long search.
+  std::string search(const fs::path &root, const std::string &query)
+  {
+    SearchCacheEntry entry;
+    bool watched;
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      watched = watched_roots_.count(root.string()) > 0;
+    }
+    if (!watched)
+    {
+      // Without watches on the whole tree we can't tell when results go
+      // stale, so this root bypasses the cache until it is watched.
+      entry.matches = find_in_files(root, query, &entry.files);
+    }
+    else
+    {
+      SearchPlan plan;
+      {
+        std::lock_guard<std::mutex> lock(m_);
+        plan = plan_search(root, query);
+        if (plan.hit)
+          entry = search_cache.front();
+      }
+      if (!plan.hit)
+      {
+        entry = run_search(root, query, plan);
+        std::lock_guard<std::mutex> lock(m_);
+        store_search(entry);
+      }
+    }
+
+    std::string reply;
+    for (std::size_t i = 0; i < entry.matches.size(); ++i)
     {
-      try
+      const Match &m = entry.matches[i];
+      std::uintmax_t size = i < entry.files.size() ? entry.files[i].size : 0;
+      reply += "M " + std::to_string(m.line) + " " + std::to_string(size) + " " +
+               escape_field(m.file.string()) + " " + escape_field(m.preview) + "\n";
+    }
+    if (!watched)
+    {
+      // Only trust the root if nothing was unwatched while we walked it.
+      std::uint64_t epoch;
       {
-        std::vector<fs::path> entries;
-        for (auto const &e : fs::directory_iterator(path))
-          entries.push_back(e.path());
-        std::sort(entries.begin(), entries.end(),
-                  [](const fs::path &a, const fs::path &b)
-                  {
-                    bool ad = fs::is_directory(a), bd = fs::is_directory(b);
-                    if (ad != bd)
-                      return ad > bd;
-                    return a.filename().string() < b.filename().string();
-                  });
-        for (auto &e : entries)
-          children.emplace_back(std::make_unique<Node>(e, this));
+        std::lock_guard<std::mutex> lock(m_);
+        epoch = unwatched_;
       }
-      catch (...)
+      if (watch_tree(root))
       {
+        std::lock_guard<std::mutex> lock(m_);
+        if (unwatched_ == epoch)
+          watched_roots_.insert(root.string());
       }
     }
+    return reply;
   }
-};
 
-static void collect_visible(Node *root, int depth, std::vector<std::pair<Node *, int>> &out)
-{
-  out.emplace_back(root, depth);
-  if (root->isDir && root->expanded)
-    for (auto &c : root->children)
-      collect_visible(c.get(), depth + 1, out);
-}
-static std::vector<std::pair<Node *, int>> visible_nodes(Node *root)
-{
-  std::vector<std::pair<Node *, int>> v;
-  collect_visible(root, 0, v);
-  return v;
-}
+#if defined(__linux__)
+  static constexpr std::uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY |
+                                              IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
 
-static std::optional<std::string> exe_dir_path()
-{
-#if defined(_WIN32)
-  char buf[MAX_PATH];
-  DWORD len = GetModuleFileNameA(nullptr, buf, MAX_PATH);
-  if (len == 0 || len == MAX_PATH)
-    return std::nullopt;
-  return fs::path(buf).parent_path().string();
-#else
-  // Linux: /proc/self/exe, macOS: _NSGetExecutablePath
-  fs::path p;
-#if defined(__APPLE__)
-  uint32_t size = 0;
-  _NSGetExecutablePath(nullptr, &size);
-  std::string tmp(size, '\0');
-  if (_NSGetExecutablePath(tmp.data(), &size) != 0)
-    return std::nullopt;
-  p = fs::path(tmp).lexically_normal();
-#else
-  char buf[PATH_MAX];
-  ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
-  if (n < 0)
-    return std::nullopt;
-  buf[n] = '\0';
-  p = fs::path(buf);
-#endif
-  return p.parent_path().string();
-#endif
-}
+  // Called with m_ held. The kernel hands back the wd it already has for a
+  // folder, so that is what decides whether the path is still covered; a
+  // cached path may name a folder that was renamed away and recreated.
+  bool watch(const fs::path &dir)
+  {
+    if (inotify_ < 0)
+      return false;
+    if (!dir_wds_.count(dir.string()) && dir_wds_.size() >= max_watches_)
+      return false;
+    int wd = inotify_add_watch(inotify_, dir.c_str(), WATCH_MASK);
+    if (wd < 0)
+      return false;
+    record_watch(dir.string(), wd);
+    return true;
+  }
 
-static std::optional<std::string> read_editor_for_ext(const std::string &ext)
-{
-  try
+  void record_watch(const std::string &path, int wd)
   {
-    auto dir = exe_dir_path();
-    if (!dir)
-      return std::nullopt;
-    fs::path cfg = fs::path(*dir) / ".dirtconfig";
-    if (!fs::exists(cfg))
-      return std::nullopt;
+    auto known = dir_wds_.find(path);
+    if (known != dir_wds_.end() && known->second != wd)
+    {
+      // The old wd follows a folder that now lives somewhere else.
+      int stale = known->second;
+      dir_wds_.erase(known);
+      wd_dirs_.erase(stale);
+      inotify_rm_watch(inotify_, stale);
+      listings_.erase(path);
+    }
+    wd_dirs_[wd] = path;
+    dir_wds_[path] = wd;
+  }
 
-    std::ifstream f(cfg);
-    std::string line, generic;
-    std::string ext_lower = ext;
-    std::transform(ext_lower.begin(), ext_lower.end(), ext_lower.begin(), ::tolower);
+  // Walks the tree without m_ so listings and events don't wait behind it.
+  // Each folder is watched before it is read, so nothing created meanwhile
+  // slips through; the wds are recorded under the lock at the end.
+  bool watch_tree(const fs::path &root)
+  {
+    if (inotify_ < 0)
+      return false;
+    std::size_t room;
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      room = max_watches_ > dir_wds_.size() ? max_watches_ - dir_wds_.size() : 0;
+    }
+    std::vector<std::pair<std::string, int>> added;
+    auto add = [&](const fs::path &dir)
+    {
+      if (added.size() >= room)
+        return false;
+      int wd = inotify_add_watch(inotify_, dir.c_str(), WATCH_MASK);
+      if (wd < 0)
+        return false;
+      added.emplace_back(dir.string(), wd);
+      return true;
+    };
 
-    while (std::getline(f, line))
+    bool ok = add(root);
+    WalkOptions opts = walk_options();
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec), end; ok && it != end; it.increment(ec))
     {
-      line.erase(0, line.find_first_not_of(" \t\r\n"));
-      if (!line.empty())
-        line.erase(line.find_last_not_of(" \t\r\n") + 1);
-      if (line.empty() || line[0] == '#')
+      if (!it->is_directory(ec) || it->is_symlink(ec))
         continue;
-
-      if (line.rfind("editor_generic=", 0) == 0)
+      if (opts.skips_dir(it->path().filename().string()))
       {
-        generic = line.substr(15);
-      }
-      else if (!ext_lower.empty() && line.rfind(ext_lower + "=", 0) == 0)
-      {
-        return line.substr(ext_lower.size() + 1);
+        it.disable_recursion_pending();
+        continue;
       }
+      ok = add(it->path());
     }
 
-    if (!generic.empty())
-      return generic;
+    std::lock_guard<std::mutex> lock(m_);
+    for (auto &[path, wd] : added)
+      record_watch(path, wd);
+    return ok;
   }
-  catch (...)
+
+  static bool within(const std::string &path, const std::string &dir)
   {
+    if (path.compare(0, dir.size(), dir) != 0)
+      return false;
+    return path.size() == dir.size() || path[dir.size()] == '/' || (!dir.empty() && dir.back() == '/');
   }
-  return std::nullopt;
-}
-
-static std::optional<std::string> pick_editor(const std::string &ext = "")
-{
-  if (auto cfg = read_editor_for_ext(ext))
-    return cfg;
 
-  for (auto &e : fallback_editors())
+  // Called with m_ held when `path` stops being where we watched it: drops
+  // the watches on it and on every folder cached below it, with their
+  // listings. Roots inside it are no longer watched; roots above it are
+  // only distrusted when the folder may have gone without us seeing what
+  // replaced it (keep_outer false).
+  void drop_tree(const std::string &path, bool keep_outer)
   {
-    if (e.empty())
-      continue;
-#if defined(_WIN32)
-    if (fs::path(e).is_absolute())
+    std::unordered_set<int> gone;
+    for (auto &[dir, wd] : dir_wds_)
+      if (within(dir, path))
+        gone.insert(wd);
+    for (auto it = dir_wds_.begin(); it != dir_wds_.end();)
+      it = gone.count(it->second) ? dir_wds_.erase(it) : std::next(it);
+    for (int wd : gone)
     {
-      if (fs::exists(e))
-        return e;
+      wd_dirs_.erase(wd);
+      inotify_rm_watch(inotify_, wd);
     }
-    else
+    for (auto it = listings_.begin(); it != listings_.end();)
+      it = within(it->first, path) ? listings_.erase(it) : std::next(it);
+    for (auto it = watched_roots_.begin(); it != watched_roots_.end();)
+      it = (within(*it, path) || (!keep_outer && within(path, *it))) ? watched_roots_.erase(it) : std::next(it);
+    ++unwatched_;
+  }
+
+  void pump_events()
+  {
+    alignas(inotify_event) char buf[1 << 16];
+    for (;;)
     {
-      return e;
+      ssize_t n = ::read(inotify_, buf, sizeof(buf));
+      if (n <= 0)
+      {
+        if (n < 0 && errno == EINTR)
+          continue;
+        return;
+      }
+      std::vector<fs::path> fresh;
+      {
+        std::lock_guard<std::mutex> lock(m_);
+        ++tree_generation;
+        for (char *p = buf; p < buf + n;)
+        {
+          auto *ev = (inotify_event *)p;
+          p += sizeof(inotify_event) + ev->len;
+          if (ev->mask & IN_Q_OVERFLOW)
+          {
+            // Events were lost, so new folders may have no watch: every
+            // root skips the cache until a search walks it again.
+            listings_.clear();
+            watched_roots_.clear();
+            ++unwatched_;
+            continue;
+          }
+          auto dir = wd_dirs_.find(ev->wd);
+          if (dir == wd_dirs_.end())
+            continue;
+          std::string path = dir->second;
+          listings_.erase(path);
+          if ((ev->mask & IN_ISDIR) && ev->len)
+          {
+            fs::path child = fs::path(path) / ev->name;
+            if (ev->mask & IN_MOVED_FROM)
+              drop_tree(child.string(), true);
+            if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+              fresh.push_back(child);
+          }
+          if (ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF))
+            drop_tree(path, true);
+          else if (ev->mask & IN_IGNORED)
+            drop_tree(path, false);
+        }
+      }
+
+      // Keep new folders inside a fully watched tree covered too.
+      for (auto &child : fresh)
+      {
+        bool ok = watch_tree(child);
+        std::lock_guard<std::mutex> lock(m_);
+        if (!ok)
+          for (auto it = watched_roots_.begin(); it != watched_roots_.end();)
+            it = within(child.string(), *it) ? watched_roots_.erase(it) : std::next(it);
+        // Anything cached while the new folder had no watch may miss it.
+        ++tree_generation;
+      }
     }
+  }
+
+  int inotify_ = -1;
+  std::unordered_map<int, std::string> wd_dirs_;
+  std::unordered_map<std::string, int> dir_wds_;
 #else
-    if (!fs::path(e).is_absolute())
-      return e;
-    if (fs::exists(e))
-      return e;
+  // No inotify: listings are revalidated by folder mtime and searches are
+  // never served from cache.
+  bool watch(const fs::path &) { return false; }
+  bool watch_tree(const fs::path &) { return false; }
 #endif
-  }
-  return std::nullopt;
-}
 
-struct ScopedAltScreenPause
+  std::string socket_path_;
+  std::mutex m_;
+  std::unordered_map<std::string, CachedListing> listings_;
+  std::unordered_set<std::string> watched_roots_;
+  std::uint64_t unwatched_ = 0;
+  std::size_t max_watches_ = 65536;
+};
+
+#endif
+
+// ---- recursive expand -----------------------------------------------------
+// `*` expands everything below the selected folder. A pool of threads lists
+// folders (the slow part: a stat per entry) while the main thread turns each
+// finished listing into Nodes, queues its subfolders and redraws now and
+// then. Nodes are only created on the main thread since they update the
+// shared memory budget. Skip rules are the same as for search, and
+// expand_depth / expand_limit bound how far it goes.
+
+static constexpr int DEFAULT_EXPAND_DEPTH = 64;
+static constexpr std::size_t DEFAULT_EXPAND_LIMIT = 250000;
+
+class ListingPool
 {
-  ScopedAltScreenPause()
+public:
+  struct Job
   {
-    std::cout << "\033[?1049l\033[?25h";
-    std::cout.flush();
+    Node *node = nullptr; // only handed back, never touched by the workers
+    fs::path dir;
+    int depth = 0;
+    std::uint64_t dev = 0;
+  };
+
+  struct Done
+  {
+    Job job;
+    std::vector<EntryMeta> entries;
+  };
+
+  explicit ListingPool(unsigned threads)
+  {
+    for (unsigned t = 0; t < threads; ++t)
+      threads_.emplace_back([this]
+                            { work(); });
   }
-  ~ScopedAltScreenPause()
+
+  // Folders still queued are dropped; ones being listed are finished first.
+  ~ListingPool()
   {
-    std::cout << "\033[?1049h\033[?25l\033[2J\033[H";
-    std::cout.flush();
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      stop_ = true;
+      jobs_.clear();
+    }
+    work_cv_.notify_all();
+    for (auto &t : threads_)
+      t.join();
   }
-};
 
-static void open_in_editor_at(const fs::path &p, int line)
-{
-  std::string ext = p.has_extension() ? p.extension().string() : "";
-  auto ed = pick_editor(ext);
-  if (!ed)
+  void add(Job job)
   {
-#if defined(_WIN32)
-    ShellExecuteA(NULL, "open", p.string().c_str(), NULL, NULL, SW_SHOWNORMAL);
-#else
-    std::string cmd = "xdg-open \"" + p.string() + "\"";
-    std::system(cmd.c_str());
-#endif
-    return;
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      jobs_.push_back(std::move(job));
+      ++outstanding_;
+    }
+    work_cv_.notify_one();
   }
 
-  std::string editor = *ed;
-  std::string low = editor;
-  std::transform(low.begin(), low.end(), low.begin(), ::tolower);
-  bool is_vim = (low.find("vim") != std::string::npos);
+  bool idle()
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    return outstanding_ == 0;
+  }
 
-#if defined(_WIN32)
-  if (is_vim && line > 0)
+  bool take(Done &out, std::chrono::milliseconds wait)
   {
-    std::string plus = "+" + std::to_string(line);
-    _spawnlp(_P_WAIT, editor.c_str(), editor.c_str(), plus.c_str(), p.string().c_str(), nullptr);
+    std::unique_lock<std::mutex> lock(m_);
+    if (!done_cv_.wait_for(lock, wait, [&]
+                           { return !done_.empty(); }))
+      return false;
+    out = std::move(done_.front());
+    done_.pop_front();
+    --outstanding_;
+    return true;
   }
-  else
+
+private:
+  void work()
   {
-    _spawnlp(_P_WAIT, editor.c_str(), editor.c_str(), p.string().c_str(), nullptr);
+    std::unique_lock<std::mutex> lock(m_);
+    while (true)
+    {
+      work_cv_.wait(lock, [&]
+                    { return stop_ || !jobs_.empty(); });
+      if (stop_)
+        return;
+      Done d{std::move(jobs_.front()), {}};
+      jobs_.pop_front();
+      lock.unlock();
+      // Listed locally: the daemon connection is not shared between threads.
+      try
+      {
+        d.entries = list_directory_local(d.job.dir);
+      }
+      catch (...)
+      {
+      }
+      lock.lock();
+      done_.push_back(std::move(d));
+      done_cv_.notify_one();
+    }
   }
-#else
-  std::string cmd = editor;
-  if (is_vim && line > 0)
-    cmd += " +" + std::to_string(line);
-  cmd += " \"" + p.string() + "\"";
-  std::system(cmd.c_str());
-#endif
-}
 
-static void open_in_editor(const fs::path &p) { open_in_editor_at(p, -1); }
+  std::mutex m_;
+  std::condition_variable work_cv_, done_cv_;
+  std::deque<Job> jobs_;
+  std::deque<Done> done_;
+  std::size_t outstanding_ = 0; // queued, being listed, or waiting in done_
+  bool stop_ = false;
+  std::vector<std::thread> threads_;
+};
 
-static std::string to_lower_copy(std::string s)
+// `tick` is called every so often with a progress line; returning false
+// cancels. Folders not listed by then are left collapsed. Returns a summary.
+static std::string expand_subtree(Node *top, const std::function<bool(const std::string &)> &tick)
 {
-  std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c)
-                 { return std::tolower(c); });
-  return s;
-}
+  if (!top->isDir)
+    return "";
+  WalkOptions opts = walk_options();
+  DirGuard guard(opts);
+  int max_depth = (int)parse_size(read_config_value("expand_depth").value_or("")).value_or(DEFAULT_EXPAND_DEPTH);
+  std::size_t max_entries = (std::size_t)parse_size(read_config_value("expand_limit").value_or("")).value_or(DEFAULT_EXPAND_LIMIT);
 
-struct Match
-{
-  fs::path file;
-  int line;
-  std::string preview;
-};
+  ListingPool pool(search_threads());
+  std::unordered_set<Node *> waiting;
+  std::size_t dirs = 0, entries = 0;
+  bool capped = false;
 
-static std::vector<Match> find_in_files(const fs::path &base, const std::string &query)
-{
-  std::vector<Match> results;
-  std::string q = to_lower_copy(query);
-  std::error_code ec;
-  for (fs::recursive_directory_iterator it(base, fs::directory_options::skip_permission_denied, ec), end; it != end; ++it)
+  std::function<void(Node *, int, std::uint64_t)> descend;
+  auto open = [&](Node *n, int depth, std::uint64_t dev)
   {
-    const fs::path &p = it->path();
-    if (fs::is_directory(p, ec))
-      continue;
-    if (fs::file_size(p, ec) > SIZE_CAP_BYTES)
-      continue;
-    std::ifstream f(p);
-    if (!f)
-      continue;
-    std::string line;
-    int lineno = 0;
-    while (std::getline(f, line))
+    n->expanded = true;
+    n->unlink_lru();
+    ++dirs;
+    if (n->children.empty())
+    {
+      waiting.insert(n);
+      pool.add({n, n->path, depth, dev});
+    }
+    else
+    {
+      entries += n->children.size();
+      descend(n, depth, dev);
+    }
+  };
+  descend = [&](Node *n, int depth, std::uint64_t dev)
+  {
+    if (depth >= max_depth)
+      return;
+    for (auto &c : n->children)
+    {
+      if (!c->isDir || opts.skips_dir(c->name))
+        continue;
+      std::error_code ec;
+      if (!opts.follow_symlinks && fs::is_symlink(c->path, ec))
+        continue;
+      if (entries >= max_entries)
+      {
+        capped = true;
+        return;
+      }
+      std::uint64_t cdev = 0;
+      if (guard.enter(c->path, dev, cdev))
+        open(c.get(), depth + 1, cdev);
+    }
+  };
+
+  std::uint64_t dev = 0;
+  guard.enter(top->path, 0, dev);
+  open(top, 0, dev);
+
+  bool cancelled = false;
+  auto last_tick = std::chrono::steady_clock::now();
+  ListingPool::Done d;
+  while (!pool.idle())
+  {
+    if (pool.take(d, std::chrono::milliseconds(50)))
     {
-      ++lineno;
-      if (to_lower_copy(line).find(q) != std::string::npos)
+      Node *n = d.job.node;
+      waiting.erase(n);
+      if (entries >= max_entries)
       {
-        results.push_back({p, lineno, line});
+        // Listings already queued when the limit was reached are dropped.
+        n->expanded = false;
+        --dirs;
+        capped = true;
+        continue;
+      }
+      n->children.reserve(d.entries.size());
+      for (auto &e : d.entries)
+        n->children.emplace_back(std::make_unique<Node>(std::move(e), n));
+      sort_children(n->children);
+      n->recount();
+      entries += n->children.size();
+      descend(n, d.job.depth, d.job.dev);
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_tick >= std::chrono::milliseconds(100))
+    {
+      last_tick = now;
+      if (!tick("expanding: " + std::to_string(dirs) + " folders, " + std::to_string(entries) + " entries"))
+      {
+        cancelled = true;
         break;
       }
     }
   }
-  return results;
+  for (Node *n : waiting)
+    n->expanded = false;
+  dirs -= waiting.size();
+  enforce_memory_budget();
+
+  std::string summary = std::to_string(dirs) + " folders, " + std::to_string(entries) + " entries";
+  if (cancelled)
+    return "expand stopped: " + summary;
+  if (capped)
+    return "expand hit expand_limit: " + summary;
+  return "expanded " + summary;
 }
 
 static int clamp(int v, int lo, int hi) { return (v < lo) ? lo : (v > hi ? hi : v); }
@@ -459,14 +4239,17 @@ static std::optional<Match> search_dialog_and_select(const fs::path &base)
   std::cout << "Searching for \"" << query << "\"...\n"
             << std::flush;
 
-  auto matches = find_in_files(base, query);
+  std::vector<Match> matches;
+  {
+    ScopedLatency lat("search");
+    matches = cached_search(base, query);
+  }
   if (matches.empty())
   {
     cursor_to(terminal_rows(), 1);
     clear_line();
     std::cout << "No matches. Press Enter..." << std::flush;
-    std::string dummy;
-    std::getline(std::cin, dummy);
+    read_line();
     return std::nullopt;
   }
 
@@ -500,7 +4283,10 @@ static std::optional<Match> search_dialog_and_select(const fs::path &base)
         preview.erase(120);
       if (i == sel)
         std::cout << "\033[7m";
-      std::cout << m.file.string() << ":" << m.line << "  -  " << preview << "\033[0m\n";
+      if (m.line > 0)
+        std::cout << m.file.string() << ":" << m.line << "  -  " << preview << "\033[0m\n";
+      else
+        std::cout << m.file.string() << "\033[0m\n";
     }
     std::cout.flush();
 
@@ -519,7 +4305,7 @@ static std::optional<Match> search_dialog_and_select(const fs::path &base)
 static std::vector<std::string> prev_frame;
 
 static std::tuple<std::vector<std::pair<Node *, int>>, int, int>
-draw(Node *root, int sel_index, int scroll)
+draw(Node *root, int sel_index, int scroll, const std::string &note = "")
 {
   auto vis = visible_nodes(root);
   int total = (int)vis.size();
@@ -531,8 +4317,11 @@ draw(Node *root, int sel_index, int scroll)
   std::vector<std::string> frame;
   frame.emplace_back(std::string("\033[36m") + HELP_LINE + "\033[0m");
   frame.emplace_back(std::string("\033[34mcwd: ") + fs::current_path().string() +
-                     " | items: " + std::to_string(total) + "\033[0m");
-  frame.emplace_back("");
+                     " | items: " + std::to_string(total) +
+                     " | sort: " + sort_mode_name(sort_mode) +
+                     " | nodes: " + std::to_string(budget.nodes) +
+                     " (" + format_bytes(budget.bytes) + ")\033[0m");
+  frame.emplace_back(note);
 
   for (int i = scroll; i < std::min(scroll + win_height, total); ++i)
   {
@@ -579,30 +4368,133 @@ struct TermRestore
   }
 };
 
-int main()
+int main(int argc, char **argv)
 {
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+#if !defined(_WIN32)
+    if (arg == "--daemon")
+      return DirtDaemon().run();
+#endif
+    if ((arg == "--record" || arg == "--replay") && i + 1 < argc)
+    {
+      std::string file = argv[++i];
+      if (arg == "--record")
+      {
+        session.log.open(file);
+        if (!session.log)
+        {
+          std::cerr << "dirt: cannot write " << file << "\n";
+          return 2;
+        }
+        session.recording = true;
+        session.log << "# dirt keylog 1 rows=" << terminal_rows() << "\n";
+      }
+      else if (!load_replay(file))
+      {
+        std::cerr << "dirt: cannot read " << file << "\n";
+        return 2;
+      }
+    }
+    else
+    {
+      std::cerr << "usage: dirt [--record FILE | --replay FILE | --daemon]\n";
+      return 2;
+    }
+  }
+
+  static NullBuffer null_terminal;
+  if (session.replaying)
+  {
+    std::cout.rdbuf(&null_terminal);
+    latency.enabled = true;
+  }
+
 #if defined(_WIN32)
   enableAnsiOnWindows();
   SetConsoleOutputCP(CP_UTF8);
   SetConsoleCP(CP_UTF8);
 #endif
 
+  if (auto v = read_config_value("memory_budget"))
+    if (auto n = parse_size(*v))
+      budget.limit = (std::size_t)*n;
+
+  if (auto v = read_config_value("sort"))
+    for (SortMode m : {SortMode::Name, SortMode::Natural, SortMode::NoCase, SortMode::Mtime, SortMode::Size})
+      if (to_lower_copy(*v) == sort_mode_name(m))
+        sort_mode = m;
+
+#if !defined(_WIN32)
+  if (config_flag("use_daemon", true))
+  {
+    std::signal(SIGPIPE, SIG_IGN);
+    daemon_attach();
+  }
+#endif
+
   TermRestore _guard;
-  Node root(fs::current_path());
-  root.expanded = true;
-  root.toggle();
+  auto root = std::make_unique<Node>(entry_meta(fs::current_path()));
+  root->expanded = true;
+  root->toggle();
   int sel_index = 0, scroll = 0;
+  bool jumping = false;
+  std::string jump_prefix;
+  Node *jump_origin = nullptr;
+  bool jump_missed = false;
+  std::string status; // shown once, on the next draw
 
   try
   {
     while (true)
     {
-      auto [vis, cur_scroll, win_height] = draw(&root, sel_index, scroll);
+      std::string note;
+      if (jumping)
+        note = std::string(jump_missed ? "\033[31m" : "\033[33m") + "jump: " + jump_prefix + "\033[0m";
+      else
+        note = std::move(status);
+      status.clear();
+      auto drawn_at = std::chrono::steady_clock::now();
+      auto [vis, cur_scroll, win_height] = draw(root.get(), sel_index, scroll, note);
+      latency.add("draw", drawn_at);
       scroll = cur_scroll;
       int total = (int)vis.size();
       std::string ch = read_key();
+      if (session.exhausted)
+        break;
+
+      // Type-ahead: printable keys extend the prefix, anything else ends it
+      // (Enter and ESC are swallowed, other keys then act as usual).
+      if (jumping)
+      {
+        if (ch == "\x7f" || ch == "\b")
+        {
+          if (!jump_prefix.empty())
+            jump_prefix.pop_back();
+        }
+        else if (ch.size() == 1 && std::isprint((unsigned char)ch[0]))
+          jump_prefix += ch;
+        else
+        {
+          jumping = false;
+          if (ch == "\n" || ch == "\x1b")
+            ch.clear();
+        }
+        if (jumping)
+        {
+          ch.clear();
+          Node *hit = jump_prefix.empty() ? jump_origin : jump_target(jump_origin, jump_prefix);
+          jump_missed = !hit;
+          for (int i = 0; hit && i < total; ++i)
+            if (vis[i].first == hit)
+              sel_index = i;
+        }
+      }
 
-      if (ch == "q" || ch == "\x1b")
+      if (ch.empty())
+        ;
+      else if (ch == "q" || ch == "\x1b")
         break;
       else if (ch == "UP" || ch == "k")
         sel_index = clamp(sel_index - 1, 0, total - 1);
@@ -614,7 +4506,10 @@ int main()
         {
           auto [n, _] = vis[sel_index];
           if (n->isDir && !n->expanded)
+          {
+            ScopedLatency lat("toggle");
             n->toggle();
+          }
           else if (n->isDir && !n->children.empty())
             sel_index = std::min(sel_index + 1, total - 1);
         }
@@ -625,7 +4520,10 @@ int main()
         {
           auto [n, _] = vis[sel_index];
           if (n->isDir && n->expanded)
+          {
+            ScopedLatency lat("toggle");
             n->toggle();
+          }
           else if (n->parent)
           {
             for (int i = 0; i < total; ++i)
@@ -643,13 +4541,17 @@ int main()
         {
           auto [n, _] = vis[sel_index];
           if (n->isDir)
+          {
+            ScopedLatency lat("toggle");
             n->toggle();
+          }
           else
           {
             {
               ScopedAltScreenPause pause;
               open_in_editor(n->path);
             }
+            ++tree_generation;
             prev_frame.clear();
           }
         }
@@ -665,9 +4567,9 @@ int main()
             fs::current_path(n->path, ec);
             if (!ec)
             {
-              root = Node(fs::current_path());
-              root.expanded = true;
-              root.toggle();
+              root = std::make_unique<Node>(entry_meta(fs::current_path()));
+              root->expanded = true;
+              root->toggle();
               sel_index = 0;
               scroll = 0;
               prev_frame.clear();
@@ -684,16 +4586,53 @@ int main()
             ScopedAltScreenPause pause;
             open_in_editor_at(maybe->file, maybe->line);
           }
+          ++tree_generation;
         }
         prev_frame.clear();
       }
+      else if (ch == "*")
+      {
+        if (total > 0 && vis[sel_index].first->isDir)
+        {
+          ScopedLatency lat("expand");
+          KeyPoller keys;
+          auto tick = [&](const std::string &progress)
+          {
+            scroll = std::get<1>(draw(root.get(), sel_index, scroll, "\033[33m" + progress + "  (any key stops)\033[0m"));
+            return !keys.pressed();
+          };
+          status = expand_subtree(vis[sel_index].first, tick);
+        }
+      }
       else if (ch == "r")
       {
-        root.children.clear();
-        root.expanded = true;
-        root.toggle();
+        root->release_children();
+        root->expanded = true;
+        root->toggle();
+        ++tree_generation;
         prev_frame.clear();
       }
+      else if (ch == "s")
+      {
+        Node *selected = total > 0 ? vis[sel_index].first : nullptr;
+        sort_mode = (SortMode)(((int)sort_mode + 1) % ((int)SortMode::Size + 1));
+        root->rekey();
+        resort_tree(root.get());
+        auto now = visible_nodes(root.get());
+        for (int i = 0; i < (int)now.size(); ++i)
+          if (now[i].first == selected)
+            sel_index = i;
+      }
+      else if (ch == "/")
+      {
+        if (total > 0)
+        {
+          jumping = true;
+          jump_missed = false;
+          jump_prefix.clear();
+          jump_origin = vis[sel_index].first;
+        }
+      }
       else if (ch == "g")
         sel_index = 0;
       else if (ch == "G")
@@ -709,6 +4648,9 @@ int main()
   {
   }
 
+  if (session.replaying)
+    latency.report(std::cerr);
+
   if (const char *out = std::getenv("DIRT_OUT"))
   {
     try
@@ -4,6 +4,8 @@
 #include <cstdlib>
 #include <vector>
 #include <stdexcept>
+#include <cstdint>
+#include <cstring>
 
 namespace fs = std::filesystem;
 
@@ -12,7 +14,12 @@ namespace fs = std::filesystem;
 #include <shlobj.h>
 #else
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
 #include <unistd.h>
+#if defined(__linux__)
+#include <linux/fs.h>
+#endif
 #endif
 
 #if defined(_WIN32)
@@ -21,20 +28,173 @@ static const std::string INSTALL_PATH = "C:\\Program Files\\dirt";
 static const std::string INSTALL_PATH = "/usr/local/dirt";
 #endif
 
-void copy_recursive(const fs::path &src, const fs::path &dst)
+struct InstallStats
+{
+    int copied = 0;
+    int unchanged = 0;
+};
+
+// The release binary is installed as dirt-bin so the wrapper can own `dirt`.
+fs::path install_name(const fs::path &rel)
+{
+#if defined(_WIN32)
+    if (rel == "dirt.exe")
+        return "dirt-bin.exe";
+#else
+    if (rel == "dirt")
+        return "dirt-bin";
+#endif
+    return rel;
+}
+
+// FNV-1a over the whole file; only used when --verify is given.
+std::uint64_t content_hash(const fs::path &p)
+{
+    std::ifstream f(p, std::ios::binary);
+    if (!f)
+        throw std::runtime_error("Cannot read: " + p.string());
+    std::uint64_t h = 1469598103934665603ull;
+    char buf[1 << 16];
+    while (f.read(buf, sizeof(buf)), f.gcount() > 0)
+        for (std::streamsize i = 0; i < f.gcount(); ++i)
+            h = (h ^ (unsigned char)buf[i]) * 1099511628211ull;
+    return h;
+}
+
+// Installed copies get the source mtime, so equal size and mtime means the
+// file was installed from this release already.
+bool up_to_date(const fs::path &src, const fs::path &dst, bool verify)
+{
+    std::error_code ec;
+    if (!fs::is_regular_file(dst, ec))
+        return false;
+    if (fs::file_size(src) != fs::file_size(dst, ec) || ec)
+        return false;
+    if (fs::last_write_time(src) != fs::last_write_time(dst, ec) || ec)
+        return false;
+    return !verify || content_hash(src) == content_hash(dst);
+}
+
+#if !defined(_WIN32)
+
+// Reflink if the filesystem can share extents, else let the kernel copy with
+// copy_file_range, else fall back to read/write.
+void copy_contents(const fs::path &src, const fs::path &dst)
+{
+    int in = ::open(src.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+        throw std::runtime_error("Cannot read: " + src.string());
+    int out = ::open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (out < 0)
+    {
+        ::close(in);
+        throw std::runtime_error("Cannot write: " + dst.string());
+    }
+
+    bool done = false;
+    bool ok = true;
+#if defined(__linux__)
+    if (::ioctl(out, FICLONE, in) == 0)
+        done = true;
+    struct stat st;
+    if (!done && ::fstat(in, &st) == 0)
+    {
+        off_t left = st.st_size;
+        while (left > 0)
+        {
+            ssize_t n = ::copy_file_range(in, nullptr, out, nullptr, (size_t)left, 0);
+            if (n <= 0)
+                break;
+            left -= n;
+        }
+        done = (left == 0);
+        if (!done)
+        {
+            // Start over with plain I/O from wherever the kernel gave up.
+            ::lseek(in, 0, SEEK_SET);
+            ::lseek(out, 0, SEEK_SET);
+            if (::ftruncate(out, 0) != 0)
+                ok = false;
+        }
+    }
+#endif
+    if (!done && ok)
+    {
+        char buf[1 << 16];
+        ssize_t n;
+        while (ok && (n = ::read(in, buf, sizeof(buf))) > 0)
+            for (ssize_t off = 0; off < n;)
+            {
+                ssize_t w = ::write(out, buf + off, (size_t)(n - off));
+                if (w <= 0)
+                {
+                    ok = false;
+                    break;
+                }
+                off += w;
+            }
+        if (n < 0)
+            ok = false;
+    }
+    if (::fsync(out) != 0)
+        ok = false;
+    ::close(in);
+    if (::close(out) != 0)
+        ok = false;
+    if (!ok)
+        throw std::runtime_error("Failed to copy " + src.string());
+}
+
+#else
+
+void copy_contents(const fs::path &src, const fs::path &dst)
+{
+    fs::copy_file(src, dst, fs::copy_options::overwrite_existing);
+}
+
+#endif
+
+// Copies next to the target and renames over it, so anything running the
+// installed file sees either the old copy or the new one, never half of it.
+void install_file(const fs::path &src, const fs::path &target)
+{
+    fs::path tmp = target.parent_path() / ("." + target.filename().string() + ".dirt-tmp");
+    try
+    {
+        copy_contents(src, tmp);
+        fs::permissions(tmp, fs::status(src).permissions());
+        fs::last_write_time(tmp, fs::last_write_time(src));
+        fs::rename(tmp, target);
+    }
+    catch (...)
+    {
+        std::error_code ec;
+        fs::remove(tmp, ec);
+        throw;
+    }
+}
+
+InstallStats copy_recursive(const fs::path &src, const fs::path &dst, bool verify)
 {
     if (!fs::exists(src))
         throw std::runtime_error("Source folder not found: " + src.string());
     fs::create_directories(dst);
+    InstallStats stats;
     for (auto &p : fs::recursive_directory_iterator(src))
     {
         fs::path rel = fs::relative(p.path(), src);
-        fs::path target = dst / rel;
+        fs::path target = dst / install_name(rel);
         if (fs::is_directory(p))
             fs::create_directories(target);
+        else if (up_to_date(p.path(), target, verify))
+            ++stats.unchanged;
         else
-            fs::copy_file(p, target, fs::copy_options::overwrite_existing);
+        {
+            install_file(p.path(), target);
+            ++stats.copied;
+        }
     }
+    return stats;
 }
 
 #if defined(_WIN32)
@@ -195,19 +355,22 @@ bool add_to_shell_rc_unix(const std::string &dir)
 
 #endif
 
-int main()
+int main(int argc, char **argv)
 {
     try
     {
         fs::path src = "dirt";
         fs::path dest = INSTALL_PATH;
+        bool verify = false;
+        for (int i = 1; i < argc; ++i)
+            if (std::strcmp(argv[i], "--verify") == 0)
+                verify = true;
 
         std::cout << "Installing Dirt to: " << dest << std::endl;
-        copy_recursive(src, dest);
+        InstallStats stats = copy_recursive(src, dest, verify);
+        std::cout << stats.copied << " file(s) updated, " << stats.unchanged << " unchanged.\n";
 
 #if defined(_WIN32)
-        fs::rename(dest / "dirt.exe", dest / "dirt-bin.exe");
-
         create_windows_wrappers();
 
         if (add_to_path_windows(dest.string()))
@@ -220,8 +383,6 @@ int main()
         system("pause");
 
 #else
-        fs::rename(dest / "dirt", dest / "dirt-bin");
-
         bool ok_fn = write_unix_function(dest.string());
         bool ok_rc = add_to_shell_rc_unix(dest.string());
 